@@ -49,7 +49,11 @@ Ray PerspectiveCamera::generateRay(const Vector2f &point, RNG &rng) const {
     } while (x_disturb * x_disturb + y_disturb * y_disturb > 1);
 
     Vector3f ray_point = center + right * aperture * x_disturb + up * aperture * y_disturb;
-    return {ray_point, point_on_focal - ray_point, shutter_time * rng.RandUniformFloat()};
+    Ray ray(ray_point, point_on_focal - ray_point, shutter_time * rng.RandUniformFloat());
+    // the rays one pixel away share the aperture sample
+    ray.SetDifferentials(ray_point, point_on_focal + right * focal_scale - ray_point,
+                         ray_point, point_on_focal + up * focal_scale - ray_point);
+    return ray;
 }
 
 } // namespace RT
@@ -11,6 +11,11 @@ Hit::Hit() {
     material = nullptr;
 }
 
+Hit::Hit(float t_max) {
+    t = t_max;
+    material = nullptr;
+}
+
 Hit::Hit(const Hit &h) {
     t = h.t;
     material = h.material;
@@ -42,6 +47,10 @@ const Vector3f &Hit::GetPos() const {
     return pos;
 }
 
+const SimpleObject3D *Hit::GetObject() const {
+    return obj;
+}
+
 inline std::ostream &operator<<(std::ostream &os, const Hit &h) {
     os << "Hit <" << h.GetT() << ", " << h.GetNormal() << ">";
     return os;
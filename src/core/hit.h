@@ -14,6 +14,9 @@ public:
     // constructors
     Hit();
 
+    // only accept hits closer than t_max, e.g. for shadow rays
+    explicit Hit(float t_max);
+
     Hit(const Hit &h);
 
     // destructor
@@ -24,6 +27,7 @@ public:
     [[nodiscard]] const Material *GetMaterial() const;
     [[nodiscard]] const Vector3f &GetNormal() const;
     [[nodiscard]] const Vector3f &GetPos() const;
+    [[nodiscard]] const SimpleObject3D *GetObject() const;
 
     [[nodiscard]] Vector3f GetAmbient() const;
 
@@ -1,22 +1,214 @@
+#include <algorithm>
+#include <cmath>
+
 #include "utils/math_util.h"
+#include "utils/debug.h"
+#include "objects/object3d.h"
+#include "core/material.h"
 
 #include "./light.h"
 
 namespace RT {
 
+ColoredRay Light::EmitRayTowards(const Vector3f &dir, RNG &rng) const {
+    LOG(FATAL) << "EmitRayTowards() is only supported by isotropic lights";
+    return EmitRay(rng);
+}
+
 ColoredRay PointLight::EmitRay(RNG &rng) const {
-    Vector3f dir = rng.RandNormalizedVector();
+    return EmitRayTowards(rng.RandNormalizedVector(), rng);
+}
+
+ColoredRay PointLight::EmitRayTowards(const Vector3f &dir, RNG &rng) const {
     return {center, dir, color, 0};
 }
 
 PointLight::PointLight(const Vector3f &center, const Vector3f &color): center(center), color(color) {}
 
+LightSample PointLight::SampleLi(const Vector3f &pos, RNG &rng) const {
+    // color is the total power, thus the intensity is color / 4pi
+    Vector3f to_light = center - pos;
+    float dist2 = to_light.squaredLength();
+    float dist = std::sqrt(dist2);
+    return {to_light / dist, dist, color / (4 * (float) M_PI * dist2), 1.f, false};
+}
+
+Vector3f PointLight::Power() const {
+    return color;
+}
+
+LightBounds PointLight::Bounds() const {
+    LightBounds bounds;
+    bounds.box.AddVertex(center);
+    bounds.phi = luminance(color);
+    bounds.axis = Vector3f(0, 0, 1);
+    return bounds;
+}
+
 SphereLight::SphereLight(const Vector3f &center, float radius, const Vector3f &color): center(center), radius(radius), color(color) {}
 
 ColoredRay SphereLight::EmitRay(RNG &rng) const {
-    Vector3f dir = rng.RandNormalizedVector();
+    return EmitRayTowards(rng.RandNormalizedVector(), rng);
+}
+
+ColoredRay SphereLight::EmitRayTowards(const Vector3f &dir, RNG &rng) const {
     Vector3f orig = center + radius * rng.RandNormalizedVector();
     return {orig, dir, color, 0};
 }
 
-} // namespace RT
\ No newline at end of file
+LightSample SphereLight::SampleLi(const Vector3f &pos, RNG &rng) const {
+    Vector3f point;
+    float pdf = sample_sphere_cone(pos, center, radius, rng, point);
+    if (pdf == 0) return LightSample{};
+    Vector3f to_light = point - pos;
+    float dist = to_light.length();
+    // color is the total power, emitted uniformly from a surface of area 4 pi r^2
+    Vector3f radiance = color / (4 * fsquare((float) M_PI * radius));
+    return {to_light / dist, dist, radiance, pdf, false};
+}
+
+Vector3f SphereLight::Power() const {
+    return color;
+}
+
+LightBounds SphereLight::Bounds() const {
+    LightBounds bounds;
+    bounds.box.AddVertex(center - Vector3f(radius));
+    bounds.box.AddVertex(center + Vector3f(radius));
+    bounds.phi = luminance(color);
+    bounds.axis = Vector3f(0, 0, 1);
+    return bounds;
+}
+
+ObjectLight::ObjectLight(const SimpleObject3D *obj): obj(obj) {}
+
+ColoredRay ObjectLight::EmitRay(RNG &rng) const {
+    Vector3f normal;
+    Vector3f orig = obj->SampleSurface(rng, normal);
+    if (rng.RandUniformFloat() < 0.5f) normal = -normal;  // two-sided
+    Vector3f dir = normal + rng.RandNormalizedVector();
+    return {orig, dir, Power(), 0};
+}
+
+LightSample ObjectLight::SampleLi(const Vector3f &pos, RNG &rng) const {
+    Vector3f point, normal;
+    float pdf = obj->SampleFrom(pos, rng, point, normal);
+    if (pdf == 0) return LightSample{};
+    Vector3f to_light = point - pos;
+    float dist = to_light.length();
+    return {to_light / dist, dist, obj->GetMaterial()->emissionColor, pdf, true};
+}
+
+float ObjectLight::PdfLi(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const {
+    return obj->PdfFrom(ref, point, normal);
+}
+
+Vector3f ObjectLight::Power() const {
+    // lambert emission from both sides of the surface
+    return obj->GetMaterial()->emissionColor * 2 * (float) M_PI * obj->Area();
+}
+
+LightBounds ObjectLight::Bounds() const {
+    LightBounds bounds;
+    bounds.box = obj->GetBox();
+    bounds.phi = luminance(Power());
+    obj->NormalBounds(bounds.axis, bounds.cos_theta_o);
+    bounds.two_sided = true;
+    return bounds;
+}
+
+// cos(a - b) clamped to 1 if a < b
+static float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+    if (cos_a > cos_b) return 1;
+    return cos_a * cos_b + sin_a * sin_b;
+}
+
+// sin(a - b) clamped to 0 if a < b
+static float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+    if (cos_a > cos_b) return 0;
+    return sin_a * cos_b - cos_a * sin_b;
+}
+
+static float safe_sqrt(float x) {
+    return std::sqrt(std::max(0.f, x));
+}
+
+// the importance measure of "Importance Sampling of Many Lights with Adaptive Tree Splitting" (Estevez & Kulla)
+float LightBounds::Importance(const Vector3f &pos, const Vector3f &normal) const {
+    Vector3f center((box.x0 + box.x1) / 2, (box.y0 + box.y1) / 2, (box.z0 + box.z1) / 2);
+    Vector3f half_diag((box.x1 - box.x0) / 2, (box.y1 - box.y0) / 2, (box.z1 - box.z0) / 2);
+    float radius2 = half_diag.squaredLength();
+    float dist2 = std::max((pos - center).squaredLength(), std::sqrt(radius2));
+
+    // angle between the normal cone axis and the direction to pos
+    Vector3f wi = (pos - center).normalized();
+    float cos_theta_w = Vector3f::dot(axis, wi);
+    if (two_sided) cos_theta_w = std::abs(cos_theta_w);
+    float sin_theta_w = safe_sqrt(1 - cos_theta_w * cos_theta_w);
+
+    // angle subtended by the bounding sphere of the box
+    float cos_theta_b = dist2 <= radius2 ? -1 : safe_sqrt(1 - radius2 / dist2);
+    float sin_theta_b = safe_sqrt(1 - cos_theta_b * cos_theta_b);
+
+    // minimal angle between the emission direction and pos
+    float sin_theta_o = safe_sqrt(1 - cos_theta_o * cos_theta_o);
+    float cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+    float sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+    float cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+    if (cos_theta_p <= cos_theta_e) return 0;
+
+    float importance = phi * cos_theta_p / dist2;
+
+    // minimal incident angle at pos, normal may be zero for points without a surface
+    if (normal.squaredLength() > 0) {
+        float cos_theta_i = std::abs(Vector3f::dot(wi, normal.normalized()));
+        float sin_theta_i = safe_sqrt(1 - cos_theta_i * cos_theta_i);
+        importance *= cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+    }
+    return std::max(importance, 0.f);
+}
+
+// rotate v around the normalized axis k
+static Vector3f rotate(const Vector3f &v, const Vector3f &k, float theta) {
+    float c = std::cos(theta), s = std::sin(theta);
+    return v * c + Vector3f::cross(k, v) * s + k * Vector3f::dot(k, v) * (1 - c);
+}
+
+LightBounds LightBounds::Union(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0) return b;
+    if (b.phi == 0) return a;
+
+    LightBounds bounds;
+    bounds.box = a.box;
+    bounds.box.FitBox(b.box);
+    bounds.phi = a.phi + b.phi;
+    bounds.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+    bounds.two_sided = a.two_sided || b.two_sided;
+
+    // merge the normal cones
+    float theta_a = std::acos(std::clamp(a.cos_theta_o, -1.f, 1.f));
+    float theta_b = std::acos(std::clamp(b.cos_theta_o, -1.f, 1.f));
+    float theta_d = std::acos(std::clamp(Vector3f::dot(a.axis, b.axis), -1.f, 1.f));
+    if (std::min(theta_d + theta_b, (float) M_PI) <= theta_a) {
+        bounds.axis = a.axis;
+        bounds.cos_theta_o = a.cos_theta_o;
+        return bounds;
+    }
+    if (std::min(theta_d + theta_a, (float) M_PI) <= theta_b) {
+        bounds.axis = b.axis;
+        bounds.cos_theta_o = b.cos_theta_o;
+        return bounds;
+    }
+    float theta_o = (theta_a + theta_d + theta_b) / 2;
+    Vector3f rot_axis = Vector3f::cross(a.axis, b.axis);
+    if (theta_o >= (float) M_PI || rot_axis.squaredLength() == 0) {  // the whole sphere
+        bounds.axis = a.axis;
+        bounds.cos_theta_o = -1;
+        return bounds;
+    }
+    bounds.axis = rotate(a.axis, rot_axis.normalized(), theta_o - theta_a);
+    bounds.cos_theta_o = std::cos(theta_o);
+    return bounds;
+}
+
+} // namespace RT
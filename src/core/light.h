@@ -5,9 +5,12 @@
 
 #include <core/ray.h>
 
+#include "utils/aabb.h"
+
 namespace RT {
 
 class RNG;
+class SimpleObject3D;
 
 class ColoredRay : public Ray {
 public:
@@ -20,9 +23,50 @@ private:
     Vector3f color;
 };
 
+// a sampled direction from a shading point towards a light
+struct LightSample {
+    Vector3f dir = Vector3f::ZERO;       // normalized
+    float dist = 0;                      // distance to the sampled point on the light
+    Vector3f radiance = Vector3f::ZERO;  // incident radiance, or intensity / dist^2 for point lights
+    float pdf = 0;                       // w.r.t. solid angle, 0 if nothing is sampled
+    // the light is scene geometry that BSDF sampled rays can hit, only then the sample needs a MIS weight
+    // point lights and sphere lights of the scene file are not, their light is only found by sampling them
+    bool hittable = false;
+};
+
+// spatial and directional extent of light sources, for choosing lights in a light BVH
+struct LightBounds {
+    AABB box;
+    float phi = 0;           // total power
+    Vector3f axis;           // cone bounding the surface normals
+    float cos_theta_o = -1;  // spread angle of the normal cone
+    float cos_theta_e = 0;   // spread of emission around each normal, pi / 2 for lambert emitters
+    bool two_sided = false;
+
+    // upper bound of the contribution to a point with the given surface normal
+    [[nodiscard]] float Importance(const Vector3f &pos, const Vector3f &normal) const;
+
+    static LightBounds Union(const LightBounds &a, const LightBounds &b);
+};
+
 class Light {
 public:
     [[nodiscard]] virtual ColoredRay EmitRay(RNG &rng) const = 0;
+
+    // true if EmitRay() picks directions uniformly over the sphere, independently of the origin
+    // such lights can emit towards a given direction, which lets the photon tracer guide the emission
+    [[nodiscard]] virtual bool IsIsotropic() const { return false; }
+    [[nodiscard]] virtual ColoredRay EmitRayTowards(const Vector3f &dir, RNG &rng) const;
+
+    // sample the incident light at pos for direct light sampling
+    [[nodiscard]] virtual LightSample SampleLi(const Vector3f &pos, RNG &rng) const = 0;
+
+    // density of SampleLi() at ref choosing the point on the light, 0 for lights invisible to rays
+    [[nodiscard]] virtual float PdfLi(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const { return 0; }
+
+    [[nodiscard]] virtual Vector3f Power() const = 0;
+    [[nodiscard]] virtual LightBounds Bounds() const = 0;
+
     virtual ~Light() = default;
 };
 
@@ -31,6 +75,11 @@ public:
     PointLight(const Vector3f &center, const Vector3f &color);
 
     [[nodiscard]] ColoredRay EmitRay(RNG &rng) const override;
+    [[nodiscard]] bool IsIsotropic() const override { return true; }
+    [[nodiscard]] ColoredRay EmitRayTowards(const Vector3f &dir, RNG &rng) const override;
+    [[nodiscard]] LightSample SampleLi(const Vector3f &pos, RNG &rng) const override;
+    [[nodiscard]] Vector3f Power() const override;
+    [[nodiscard]] LightBounds Bounds() const override;
 
 private:
     Vector3f center;
@@ -43,12 +92,35 @@ public:
     SphereLight(const Vector3f &center, float radius, const Vector3f &color);
 
     [[nodiscard]] ColoredRay EmitRay(RNG &rng) const override;
+    [[nodiscard]] bool IsIsotropic() const override { return true; }
+    [[nodiscard]] ColoredRay EmitRayTowards(const Vector3f &dir, RNG &rng) const override;
+    [[nodiscard]] LightSample SampleLi(const Vector3f &pos, RNG &rng) const override;
+    [[nodiscard]] Vector3f Power() const override;
+    [[nodiscard]] LightBounds Bounds() const override;
 
 private:
     Vector3f center;
     Vector3f color;
     float radius;
 };
+
+// an emissive object in the scene acting as an area light
+class ObjectLight : public Light {
+public:
+    explicit ObjectLight(const SimpleObject3D *obj);
+
+    [[nodiscard]] ColoredRay EmitRay(RNG &rng) const override;
+    [[nodiscard]] LightSample SampleLi(const Vector3f &pos, RNG &rng) const override;
+    [[nodiscard]] float PdfLi(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const override;
+    [[nodiscard]] Vector3f Power() const override;
+    [[nodiscard]] LightBounds Bounds() const override;
+
+    [[nodiscard]] const SimpleObject3D *GetObject() const { return obj; }
+
+private:
+    const SimpleObject3D *obj;
+};
+
 } // namespace RT
 
 #endif // RT_LIGHT_H
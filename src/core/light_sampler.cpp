@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "utils/math_util.h"
+#include "utils/debug.h"
+
+#include "./light_sampler.h"
+
+namespace RT {
+
+std::unique_ptr<LightSampler> LightSampler::Create(const std::string &name, const std::vector<const Light *> &lights) {
+    if (name == "uniform") {
+        return std::make_unique<UniformLightSampler>(lights);
+    } else if (name == "power") {
+        return std::make_unique<PowerLightSampler>(lights);
+    } else if (name == "bvh") {
+        return std::make_unique<BVHLightSampler>(lights);
+    } else {
+        throw std::runtime_error(fmt::format("unknown light sampler '{}'", name));
+    }
+}
+
+const Light *UniformLightSampler::Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const {
+    if (lights.empty()) return nullptr;
+    int n = (int) lights.size();
+    pmf = 1.f / (float) n;
+    return lights[std::min((int) (u * (float) n), n - 1)];
+}
+
+float UniformLightSampler::Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const {
+    return lights.empty() ? 0.f : 1.f / (float) lights.size();
+}
+
+PowerLightSampler::PowerLightSampler(const std::vector<const Light *> &lights) : LightSampler(lights) {
+    std::vector<float> powers;
+    powers.reserve(lights.size());
+    for (int i = 0; i < lights.size(); i++) {
+        powers.emplace_back(luminance(lights[i]->Power()));
+        light_idx[lights[i]] = i;
+    }
+    alias_table = AliasTable(powers);
+}
+
+const Light *PowerLightSampler::Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const {
+    if (lights.empty()) return nullptr;
+    int i = alias_table.Sample(u);
+    pmf = alias_table.Pmf(i);
+    return lights[i];
+}
+
+float PowerLightSampler::Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const {
+    auto it = light_idx.find(light);
+    return it == light_idx.end() ? 0.f : alias_table.Pmf(it->second);
+}
+
+BVHLightSampler::BVHLightSampler(const std::vector<const Light *> &lights) : LightSampler(lights) {
+    std::vector<std::pair<int, LightBounds>> bounds;
+    for (int i = 0; i < lights.size(); i++) {
+        LightBounds b = lights[i]->Bounds();
+        if (b.phi > 0) {  // lights without power are never chosen
+            bounds.emplace_back(i, b);
+        }
+    }
+    if (!bounds.empty()) {
+        nodes.reserve(2 * bounds.size() - 1);
+        build_impl(bounds, 0, (int) bounds.size(), 0, 0);
+    }
+    LOG(ERROR) << fmt::format("light bvh: {} lights, {} nodes", bounds.size(), nodes.size());
+}
+
+int BVHLightSampler::build_impl(std::vector<std::pair<int, LightBounds>> &bounds, int l, int r, uint64_t trail, int depth) {
+    CHECK(depth < 64) << "light bvh too deep";
+    int idx = (int) nodes.size();
+    nodes.emplace_back();
+    if (r - l == 1) {  // leaf node
+        nodes[idx].bounds = bounds[l].second;
+        nodes[idx].light = bounds[l].first;
+        light_trail[lights[bounds[l].first]] = trail;
+        return idx;
+    }
+
+    // split at the median along the axis of max span, same as BVH of objects
+    AABB centers;
+    for (int i = l; i < r; i++) {
+        centers.AddVertex(bounds[i].second.box.Center());
+    }
+    int dim = centers.MaxSpanAxis();
+    std::sort(bounds.begin() + l, bounds.begin() + r, [dim] (const auto &b1, const auto &b2) {
+        return b1.second.box.Center()[dim] < b2.second.box.Center()[dim];
+    });
+    int mid = (l + r) / 2;
+    int l_child = build_impl(bounds, l, mid, trail, depth + 1);
+    int r_child = build_impl(bounds, mid, r, trail | (1ULL << depth), depth + 1);
+    nodes[idx].l_child = l_child;
+    nodes[idx].r_child = r_child;
+    nodes[idx].bounds = LightBounds::Union(nodes[l_child].bounds, nodes[r_child].bounds);
+    return idx;
+}
+
+const Light *BVHLightSampler::Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const {
+    if (nodes.empty() || nodes[0].bounds.Importance(pos, normal) <= 0) return nullptr;
+    pmf = 1;
+    int idx = 0;
+    while (nodes[idx].light < 0) {
+        const Node &node = nodes[idx];
+        float l_importance = nodes[node.l_child].bounds.Importance(pos, normal);
+        float r_importance = nodes[node.r_child].bounds.Importance(pos, normal);
+        if (l_importance <= 0 && r_importance <= 0) return nullptr;
+
+        // choose a child and reuse u for the next level
+        float l_prob = l_importance / (l_importance + r_importance);
+        if (u < l_prob) {
+            idx = node.l_child;
+            u = std::min(u / l_prob, 0.99999994f);
+            pmf *= l_prob;
+        } else {
+            idx = node.r_child;
+            u = std::min((u - l_prob) / (1 - l_prob), 0.99999994f);
+            pmf *= 1 - l_prob;
+        }
+    }
+    return lights[nodes[idx].light];
+}
+
+float BVHLightSampler::Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const {
+    auto it = light_trail.find(light);
+    if (it == light_trail.end() || nodes[0].bounds.Importance(pos, normal) <= 0) return 0.f;
+    uint64_t trail = it->second;
+    float pmf = 1;
+    int idx = 0;
+    while (nodes[idx].light < 0) {
+        const Node &node = nodes[idx];
+        float l_importance = nodes[node.l_child].bounds.Importance(pos, normal);
+        float r_importance = nodes[node.r_child].bounds.Importance(pos, normal);
+        if (l_importance <= 0 && r_importance <= 0) return 0.f;
+        float l_prob = l_importance / (l_importance + r_importance);
+        if (trail & 1) {
+            idx = node.r_child;
+            pmf *= 1 - l_prob;
+        } else {
+            idx = node.l_child;
+            pmf *= l_prob;
+        }
+        trail >>= 1;
+    }
+    return pmf;
+}
+
+} // namespace RT
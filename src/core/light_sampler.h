@@ -0,0 +1,81 @@
+#ifndef RT_LIGHT_SAMPLER_H
+#define RT_LIGHT_SAMPLER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Vector3f.h>
+
+#include "core/light.h"
+#include "utils/alias_table.h"
+
+namespace RT {
+
+// choose one of the lights for direct light sampling at a shading point
+class LightSampler {
+public:
+    explicit LightSampler(std::vector<const Light *> lights) : lights(std::move(lights)) {};
+    virtual ~LightSampler() = default;
+
+    // choose a light with u uniformly distributed in [0, 1), return nullptr if no light can contribute
+    [[nodiscard]] virtual const Light *Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const = 0;
+
+    // probability of Sample() choosing light at pos
+    [[nodiscard]] virtual float Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const = 0;
+
+    // name is one of "uniform", "power" and "bvh"
+    static std::unique_ptr<LightSampler> Create(const std::string &name, const std::vector<const Light *> &lights);
+
+protected:
+    std::vector<const Light *> lights;
+};
+
+class UniformLightSampler : public LightSampler {
+public:
+    explicit UniformLightSampler(const std::vector<const Light *> &lights) : LightSampler(lights) {};
+
+    [[nodiscard]] const Light *Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const override;
+    [[nodiscard]] float Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const override;
+};
+
+// choose lights in proportion to their power, regardless of the shading point
+class PowerLightSampler : public LightSampler {
+public:
+    explicit PowerLightSampler(const std::vector<const Light *> &lights);
+
+    [[nodiscard]] const Light *Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const override;
+    [[nodiscard]] float Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const override;
+
+private:
+    AliasTable alias_table;
+    std::unordered_map<const Light *, int> light_idx;
+};
+
+// traverse a BVH of lights, choosing the child with probability proportional to its estimated contribution
+class BVHLightSampler : public LightSampler {
+public:
+    explicit BVHLightSampler(const std::vector<const Light *> &lights);
+
+    [[nodiscard]] const Light *Sample(const Vector3f &pos, const Vector3f &normal, float u, float &pmf) const override;
+    [[nodiscard]] float Pmf(const Vector3f &pos, const Vector3f &normal, const Light *light) const override;
+
+private:
+    struct Node {
+        LightBounds bounds;
+        int l_child = -1, r_child = -1;  // indices in nodes, -1 if leaf node
+        int light = -1;                  // index in lights if leaf node
+    };
+
+    // build the subtree of lights[l, r) and return its index in nodes
+    int build_impl(std::vector<std::pair<int, LightBounds>> &bounds, int l, int r, uint64_t trail, int depth);
+
+    std::vector<Node> nodes;
+    // path from the root to each light, the i-th bit is 1 if turning right at depth i
+    std::unordered_map<const Light *, uint64_t> light_trail;
+};
+
+} // namespace RT
+
+#endif //RT_LIGHT_SAMPLER_H
@@ -75,4 +75,19 @@ bool Material::IsDiffuse() const {
     return illumination_model == IlluminationModel::diffuse || illumination_model == IlluminationModel::blinn;
 }
 
+bool Material::IsLambert() const {
+    return illumination_model == IlluminationModel::diffuse;
+}
+
+float Material::Eval(const Ray &ray_in, const Vector3f &dir_out, const Hit &hit) const {
+    // cosine weighted sampling of lambert material has Eval() == Pdf()
+    return Pdf(ray_in, dir_out, hit);
+}
+
+float Material::Pdf(const Ray &ray_in, const Vector3f &dir_out, const Hit &hit) const {
+    const Vector3f &norm = hit.GetNormal();
+    Vector3f ray_side_norm = (Vector3f::dot(norm, ray_in.GetDirection()) > 0 ? -norm : norm).normalized();
+    return std::max(0.f, Vector3f::dot(ray_side_norm, dir_out)) / (float) M_PI;
+}
+
 } // namespace RT
@@ -41,6 +41,13 @@ public:
     [[nodiscard]] float BRDF(const Ray &ray_in, const Ray &ray_out, const Hit &hit) const;
     [[nodiscard]] bool IsDiffuse() const;
 
+    // only lambert material has a known density, thus can be lit by direct light sampling
+    [[nodiscard]] bool IsLambert() const;
+    // BRDF(in, out) * cos(out), relative to the ambient color of the hit
+    [[nodiscard]] float Eval(const Ray &ray_in, const Vector3f &dir_out, const Hit &hit) const;
+    // density of Sample() returning dir_out, w.r.t. solid angle
+    [[nodiscard]] float Pdf(const Ray &ray_in, const Vector3f &dir_out, const Hit &hit) const;
+
     IlluminationModel illumination_model;
 
     Vector3f ambientColor;  // Ka
@@ -1,3 +1,5 @@
+#include <cmath>
+
 #include "ray.h"
 
 namespace RT {
@@ -14,6 +16,80 @@ const float &Ray::GetTime() const {
     return time;
 }
 
+void Ray::SetDifferentials(const Vector3f &rx_orig, const Vector3f &rx_dir, const Vector3f &ry_orig, const Vector3f &ry_dir) {
+    has_differentials = true;
+    rx_origin = rx_orig;
+    rx_direction = rx_dir.normalized();
+    ry_origin = ry_orig;
+    ry_direction = ry_dir.normalized();
+}
+
+bool Ray::HasDifferentials() const {
+    return has_differentials;
+}
+
+void Ray::ScaleDifferentials(float scale) {
+    rx_origin = origin + (rx_origin - origin) * scale;
+    ry_origin = origin + (ry_origin - origin) * scale;
+    rx_direction = (direction + (rx_direction - direction) * scale).normalized();
+    ry_direction = (direction + (ry_direction - direction) * scale).normalized();
+}
+
+bool Ray::Footprint(const Vector3f &point, const Vector3f &normal, Vector3f &dpdx, Vector3f &dpdy) const {
+    if (!has_differentials) {
+        return false;
+    }
+    float d = Vector3f::dot(normal, point);
+    float cos_x = Vector3f::dot(normal, rx_direction), cos_y = Vector3f::dot(normal, ry_direction);
+    if (std::abs(cos_x) < 1e-6f || std::abs(cos_y) < 1e-6f) {
+        return false;
+    }
+    float tx = (d - Vector3f::dot(normal, rx_origin)) / cos_x;
+    float ty = (d - Vector3f::dot(normal, ry_origin)) / cos_y;
+    dpdx = rx_origin + rx_direction * tx - point;
+    dpdy = ry_origin + ry_direction * ty - point;
+    return true;
+}
+
+// the same mapping Material::Sample() applies to a specular direction, false on total internal reflection
+static bool specular_direction(const Vector3f &dir, const Vector3f &normal, float eta, bool reflect, Vector3f &out) {
+    float cos_in = Vector3f::dot(normal, dir);
+    if (reflect) {
+        out = dir - 2 * normal * cos_in;
+        return true;
+    }
+    float cos2t = 1.f - eta * eta * (1.f - cos_in * cos_in);
+    if (cos2t < 0) {
+        return false;
+    }
+    Vector3f side_normal = cos_in > 0 ? -normal : normal;
+    out = eta * dir - side_normal * (-eta * std::abs(cos_in) + std::sqrt(cos2t));
+    return true;
+}
+
+void Ray::PropagateSpecular(const Ray &ray_in, const Vector3f &normal, float ior) {
+    has_differentials = false;
+    Vector3f dpdx, dpdy;
+    if (!ray_in.Footprint(origin, normal, dpdx, dpdy)) {
+        return;
+    }
+    const Vector3f &dir_in = ray_in.GetDirection();
+    float cos_in = Vector3f::dot(normal, dir_in);
+    float eta = cos_in > 0 ? ior : 1.f / ior;
+    bool reflect = Vector3f::dot(normal, direction) * cos_in < 0;
+
+    // a glossy or diffuse sample does not follow the specular mapping, its footprint is unknown
+    Vector3f dir, dir_x, dir_y;
+    if (!specular_direction(dir_in, normal, eta, reflect, dir) || Vector3f::dot(dir.normalized(), direction) < 0.999f) {
+        return;
+    }
+    if (!specular_direction(ray_in.rx_direction, normal, eta, reflect, dir_x) ||
+        !specular_direction(ray_in.ry_direction, normal, eta, reflect, dir_y)) {
+        return;
+    }
+    SetDifferentials(origin + dpdx, dir_x, origin + dpdy, dir_y);
+}
+
 inline std::ostream &operator<<(std::ostream &os, const Ray &r) {
     os << "Ray <" << r.GetOrigin() << ", " << r.GetDirection() << ">";
     return os;
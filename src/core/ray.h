@@ -21,10 +21,29 @@ public:
 
     [[nodiscard]] Vector3f PointAtParameter(float t) const;
 
+    // ray differentials: the rays through the neighbouring pixels in x and y, used to size texture footprints
+    void SetDifferentials(const Vector3f &rx_orig, const Vector3f &rx_dir, const Vector3f &ry_orig, const Vector3f &ry_dir);
+
+    [[nodiscard]] bool HasDifferentials() const;
+
+    // shrink the differentials when a pixel is covered by many samples
+    void ScaleDifferentials(float scale);
+
+    // offsets of the differential rays on the tangent plane of (point, normal), false if unknown
+    bool Footprint(const Vector3f &point, const Vector3f &normal, Vector3f &dpdx, Vector3f &dpdy) const;
+
+    // carry the differentials of ray_in over a mirror reflection or a refraction at a surface with the given
+    // normal and index of refraction, the changes of the normal over the surface are ignored
+    void PropagateSpecular(const Ray &ray_in, const Vector3f &normal, float ior);
+
 private:
     Vector3f origin;
     Vector3f direction;
     float time = 0;  // for motion blur
+
+    bool has_differentials = false;
+    Vector3f rx_origin, rx_direction;
+    Vector3f ry_origin, ry_direction;
 };
 
 inline std::ostream &operator<<(std::ostream &os, const Ray &r);
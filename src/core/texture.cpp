@@ -1,8 +1,15 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <stdexcept>
 
 #include <lodepng.h>
 
 #include "texture.h"
+#include "texture_cache.h"
 #include "utils/debug.h"
 
 namespace RT {
@@ -11,30 +18,223 @@ inline float int_color_to_color(uint8_t x, float gamma) {
     return std::pow((float) x / 256.f, gamma);
 }
 
+inline uint8_t color_to_int_color(float x, float gamma) {
+    return (uint8_t) std::min(std::max((int) std::lround(std::pow(x, 1 / gamma) * 256.f), 0), 255);
+}
+
+// the texture repeats outside of [0, 1)
+inline int wrap(int i, int n) {
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+// Layout of a cache file: this header, zero padded to cache_header_bytes, then the texels of all levels.
+// The levels above the first are averaged in linear space, so they depend on the gamma used to decode the texels.
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;  // the texture file is converted again once it changes
+    uint32_t width, height;
+    float gamma;
+};
+static constexpr char cache_magic[4] = {'R', 'T', 'T', 'X'};
+static constexpr uint32_t cache_version = 2;
+static constexpr size_t cache_header_bytes = 4096;
+
 MappedTexture::MappedTexture(const std::string &filename, float gamma) {
+    for (int i = 0; i < 256; i++) {
+        decode_table[i] = int_color_to_color((uint8_t) i, gamma);
+    }
+    load(filename, gamma);
+}
+
+MappedTexture::MappedTexture(const std::string &filename, float gamma, TextureCache &cache) {
+    for (int i = 0; i < 256; i++) {
+        decode_table[i] = int_color_to_color((uint8_t) i, gamma);
+    }
+    load_cache_file(filename, gamma, cache);
+}
+
+void MappedTexture::make_levels(int width, int height) {
+    levels.clear();
+    size_t begin = 0;
+    while (true) {
+        int tiles_x = (width + tile_size - 1) / tile_size, tiles_y = (height + tile_size - 1) / tile_size;
+        levels.push_back({width, height, tiles_x, begin});
+        begin += (size_t) tiles_x * tiles_y * tile_size * tile_size * 3;
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    data_size = begin;
+}
+
+void MappedTexture::load(const std::string &filename, float gamma) {
     std::vector<uint8_t> int_texture_data;
+    uint32_t width, height;
     auto err_code = lodepng::decode(int_texture_data, width, height, filename);
 
     if (err_code) {
         throw std::runtime_error(fmt::format("load texture '{}' failed: {}", filename, lodepng_error_text(err_code)));
     };
 
-    width_f = (float) width;
-    height_f = (float) height;
-    texture_data.reserve(width * height);
-    for (uint32_t i = 0; i < width * height; i++) {
-        texture_data[i] = Vector3f(
-                int_color_to_color(int_texture_data[4 * i], gamma),
-                int_color_to_color(int_texture_data[4 * i + 1], gamma),
-                int_color_to_color(int_texture_data[4 * i + 2], gamma)
-        );
+    make_levels((int) width, (int) height);
+    storage.assign(data_size, 0);
+    data = storage.data();
+
+    const Level &base = levels[0];
+    for (int y = 0; y < (int) height; y++) {
+        for (int x = 0; x < (int) width; x++) {
+            const uint8_t *rgba = &int_texture_data[4 * (y * width + x)];
+            uint8_t *rgb = &storage[base.begin + offset(base, x, y)];
+            rgb[0] = rgba[0];
+            rgb[1] = rgba[1];
+            rgb[2] = rgba[2];
+        }
+    }
+
+    // box filter each level down to the next in linear space, an odd row or column is folded into its neighbour
+    std::vector<Vector3f> sum;
+    for (size_t l = 1; l < levels.size(); l++) {
+        const Level &fine = levels[l - 1], &coarse = levels[l];
+        sum.assign(coarse.width * coarse.height, Vector3f::ZERO);
+        for (int y = 0; y < fine.height; y++) {
+            int cy = std::min(y / 2, coarse.height - 1);
+            for (int x = 0; x < fine.width; x++) {
+                int cx = std::min(x / 2, coarse.width - 1);
+                sum[cy * coarse.width + cx] += decode(fine, x, y);
+            }
+        }
+        for (int cy = 0; cy < coarse.height; cy++) {
+            int rows = cy == coarse.height - 1 ? fine.height - 2 * cy : std::min(2, fine.height);
+            for (int cx = 0; cx < coarse.width; cx++) {
+                int cols = cx == coarse.width - 1 ? fine.width - 2 * cx : std::min(2, fine.width);
+                Vector3f average = sum[cy * coarse.width + cx] / (float) (rows * cols);
+                uint8_t *rgb = &storage[coarse.begin + offset(coarse, cx, cy)];
+                for (int c = 0; c < 3; c++) {
+                    rgb[c] = color_to_int_color(average[c], gamma);
+                }
+            }
+        }
+    }
+}
+
+void MappedTexture::load_cache_file(const std::string &filename, float gamma, TextureCache &texture_cache) {
+    struct stat source{};
+    if (stat(filename.c_str(), &source) != 0) {
+        throw std::runtime_error(fmt::format("load texture '{}' failed: no such file", filename));
     }
+    const std::string cache_path = texture_cache.CachePath(filename, gamma);
+
+    CacheHeader header{};
+    FILE *file = std::fopen(cache_path.c_str(), "rb");
+    bool fresh = file != nullptr && std::fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::memcmp(header.magic, cache_magic, 4) == 0 && header.version == cache_version &&
+                 header.source_size == (uint64_t) source.st_size && header.source_mtime == (int64_t) source.st_mtime &&
+                 header.gamma == gamma;
+    if (file != nullptr) {
+        std::fclose(file);
+    }
+    // a file cut short, e.g. by a full disk, is converted again
+    struct stat cached{};
+    if (fresh) {
+        make_levels((int) header.width, (int) header.height);
+        fresh = stat(cache_path.c_str(), &cached) == 0 && (size_t) cached.st_size == cache_header_bytes + data_size;
+    }
+
+    if (!fresh) {
+        load(filename, gamma);
+        std::memcpy(header.magic, cache_magic, 4);
+        header.version = cache_version;
+        header.source_size = source.st_size;
+        header.source_mtime = source.st_mtime;
+        header.width = levels[0].width;
+        header.height = levels[0].height;
+        header.gamma = gamma;
+        std::vector<uint8_t> padding(cache_header_bytes - sizeof(header), 0);
+        // written aside and renamed, so a concurrent render never maps half a file
+        const std::string tmp_path = fmt::format("{}.{}.tmp", cache_path, getpid());
+        file = std::fopen(tmp_path.c_str(), "wb");
+        if (file == nullptr) {
+            throw std::runtime_error(fmt::format("write texture cache file '{}' failed", tmp_path));
+        }
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  std::fwrite(padding.data(), 1, padding.size(), file) == padding.size() &&
+                  std::fwrite(storage.data(), 1, storage.size(), file) == storage.size();
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok || std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error(fmt::format("write texture cache file '{}' failed", cache_path));
+        }
+        storage.clear();
+        storage.shrink_to_fit();
+    }
+
+    make_levels((int) header.width, (int) header.height);
+    const uint8_t *mapped;
+    size_t mapped_size;
+    cache_file = texture_cache.Map(cache_path, mapped, mapped_size);
+    if (mapped_size != cache_header_bytes + data_size) {
+        throw std::runtime_error(fmt::format("texture cache file '{}' is truncated", cache_path));
+    }
+    data = mapped + cache_header_bytes;
+    // from now on lookups go through the cache
+    cache = &texture_cache;
+}
+
+size_t MappedTexture::offset(const Level &level, int x, int y) {
+    size_t tile = (size_t) (y / tile_size) * level.tiles_x + x / tile_size;
+    return 3 * (tile * tile_size * tile_size + (y % tile_size) * tile_size + x % tile_size);
+}
+
+Vector3f MappedTexture::decode(const Level &level, int x, int y) const {
+    size_t index = level.begin + offset(level, x, y);
+    if (cache != nullptr) {
+        cache->Touch(cache_file, cache_header_bytes + index);
+    }
+    const uint8_t *rgb = data + index;
+    return {decode_table[rgb[0]], decode_table[rgb[1]], decode_table[rgb[2]]};
+}
+
+int MappedTexture::Levels() const {
+    return (int) levels.size();
+}
+
+size_t MappedTexture::Bytes() const {
+    return data_size;
+}
+Vector3f MappedTexture::bilinear(const Level &level, float u, float v) const {
+    // texel centers are at half integers
+    float x = (u - std::floor(u)) * (float) level.width - 0.5f;
+    float y = (v - std::floor(v)) * (float) level.height - 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float dx = x - fx, dy = y - fy;
+    int x0 = wrap((int) fx, level.width), x1 = wrap((int) fx + 1, level.width);
+    int y0 = wrap((int) fy, level.height), y1 = wrap((int) fy + 1, level.height);
+    return (1 - dy) * ((1 - dx) * decode(level, x0, y0) + dx * decode(level, x1, y0)) +
+           dy * ((1 - dx) * decode(level, x0, y1) + dx * decode(level, x1, y1));
 }
 
 Vector3f MappedTexture::At(float u, float v) const {
-    int x = std::min((int) ((u - std::floor(u)) * width_f), (int) width - 1);
-    int y = std::min((int) ((v - std::floor(v)) * height_f), (int) height - 1);
-    return texture_data[y * width + x];
+    return bilinear(levels[0], u, v);
+}
+
+Vector3f MappedTexture::At(float u, float v, float width) const {
+    // the level where the footprint covers about one texel
+    float texels = width * (float) std::max(levels[0].width, levels[0].height);
+    float level = texels > 1 ? std::log2(texels) : 0.f;
+    if (level >= (float) (levels.size() - 1)) {
+        return decode(levels.back(), 0, 0);
+    }
+    int l = (int) level;
+    float t = level - (float) l;
+    if (t == 0) {
+        return bilinear(levels[l], u, v);
+    }
+    return (1 - t) * bilinear(levels[l], u, v) + t * bilinear(levels[l + 1], u, v);
 }
 
 } // namespace RT
@@ -11,21 +11,60 @@ namespace RT {
 class Texture {
 public:
     [[nodiscard]] virtual Vector3f At(float u, float v) const = 0;
+    // filtered over a footprint of the given width in texture coordinates, e.g. from ray differentials
+    [[nodiscard]] virtual Vector3f At(float u, float v, float width) const { return At(u, v); }
     virtual ~Texture() = default;
 };
 
+class TextureCache;
+
 class MappedTexture : public Texture {
 public:
     explicit MappedTexture(const std::string &filename, float gamma);
+    // keep the texels in a file of the cache, converted on first use, and read them through it
+    MappedTexture(const std::string &filename, float gamma, TextureCache &cache);
+    // bilinear lookup in the full resolution image
     [[nodiscard]] Vector3f At(float u, float v) const override;
+    // trilinear lookup in the mip pyramid
+    [[nodiscard]] Vector3f At(float u, float v, float width) const override;
+
+    [[nodiscard]] int Levels() const;
+    // memory held by the texels of all levels
+    [[nodiscard]] size_t Bytes() const;
 
     ~MappedTexture() override = default;
 
 private:
+    // texels are kept as gamma encoded 8-bit RGB in tiles of tile_size x tile_size, so that a bilinear lookup
+    // mostly touches one tile instead of two rows far apart
+    static constexpr int tile_size = 8;
+
+    struct Level {
+        int width, height;
+        int tiles_x;
+        size_t begin;  // of the texels in data
+    };
+
+    // the levels of a width x height image, with their texels one after another
+    void make_levels(int width, int height);
+    // decode the image and fill the mip pyramid
+    void load(const std::string &filename, float gamma);
+    void load_cache_file(const std::string &filename, float gamma, TextureCache &cache);
+    // index of the first byte of texel (x, y)
+    [[nodiscard]] static size_t offset(const Level &level, int x, int y);
+    [[nodiscard]] Vector3f decode(const Level &level, int x, int y) const;
+    [[nodiscard]] Vector3f bilinear(const Level &level, float u, float v) const;
+
     // Not supporting alpha channel yet
-    std::vector<Vector3f> texture_data;
-    uint32_t width, height, channels;
-    float width_f, height_f;
+    // levels[0] is the loaded image, each further level halves the resolution down to 1x1
+    std::vector<Level> levels;
+    std::vector<uint8_t> storage;  // the texels unless they are mapped from a cache file
+    const uint8_t *data = nullptr;
+    size_t data_size = 0;
+    TextureCache *cache = nullptr;
+    int cache_file = -1;
+    // linear value of each 8-bit texel value
+    float decode_table[256];
 };
 
 } // namespace RT
@@ -0,0 +1,131 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+
+#include "texture_cache.h"
+#include "utils/debug.h"
+
+namespace RT {
+
+namespace {
+
+// The pages a thread touched lately, lookups hitting them skip the lock. They are not forgotten when the cache
+// evicts a page: eviction only tells the kernel it may drop the page, and a read of it is still served from the
+// file. Such a page is counted again once it leaves this table, which bounds how far the budget is overrun.
+struct ThreadPages {
+    static constexpr int size = 64;
+    uint64_t cache_id = 0;
+    uint64_t keys[size];
+
+    void Reset(uint64_t owner) {
+        cache_id = owner;
+        std::fill(keys, keys + size, ~0ull);
+    }
+};
+
+thread_local ThreadPages thread_pages;
+
+// caches are told apart by id rather than by address, which a later cache may reuse
+std::atomic<uint64_t> next_cache_id{1};
+
+} // namespace
+
+TextureCache::TextureCache(const std::string &directory, size_t budget)
+    : directory(directory), budget(budget), id(next_cache_id.fetch_add(1)) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        throw std::runtime_error(fmt::format("create texture cache '{}' failed: {}", directory, ec.message()));
+    }
+}
+
+TextureCache::~TextureCache() {
+    for (const auto &mapping: mappings) {
+        munmap(mapping.data, mapping.size);
+    }
+}
+
+std::string TextureCache::CachePath(const std::string &texture_file, float gamma) const {
+    std::filesystem::path path(texture_file);
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    size_t hash = std::hash<std::string>{}(ec ? texture_file : absolute.string());
+    // scenes of different gamma keep their own files instead of converting each other's again
+    return fmt::format("{}/{}-{:016x}-g{}.rtx", directory, path.stem().string(), hash, gamma);
+}
+
+int TextureCache::Map(const std::string &cache_file, const uint8_t *&data, size_t &size) {
+    int fd = open(cache_file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(fmt::format("open texture cache file '{}' failed", cache_file));
+    }
+    struct stat st{};
+    fstat(fd, &st);
+    size = (size_t) st.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error(fmt::format("map texture cache file '{}' failed", cache_file));
+    }
+    // lookups jump around, read ahead would only fill the budget with pages nobody asked for
+    madvise(mapped, size, MADV_RANDOM);
+    data = (const uint8_t *) mapped;
+
+    std::lock_guard<std::mutex> lk(mtx);
+    mappings.push_back({(uint8_t *) mapped, size});
+    return (int) mappings.size() - 1;
+}
+
+void TextureCache::Touch(int file, size_t offset) {
+    uint64_t key = (uint64_t) file << 40 | offset / page_bytes;
+    if (thread_pages.cache_id != id) {
+        thread_pages.Reset(id);
+    }
+    uint64_t &slot = thread_pages.keys[(key ^ key >> 7) % ThreadPages::size];
+    if (slot == key) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        touch_locked(key);
+    }
+    slot = key;
+}
+
+void TextureCache::touch_locked(uint64_t key) {
+    auto it = resident.find(key);
+    if (it != resident.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    lru.push_front(key);
+    resident[key] = lru.begin();
+    if (resident.size() * page_bytes <= budget) {
+        return;
+    }
+    // evict down to 7/8 of the budget at once, so that the lock is not taken for every new page in a full cache,
+    // a page is kept even over the budget while it is the only one
+    while (resident.size() * page_bytes > budget - budget / 8 && resident.size() > 1) {
+        uint64_t victim = lru.back();
+        lru.pop_back();
+        resident.erase(victim);
+        const Mapping &mapping = mappings[victim >> 40];
+        size_t begin = (victim & ((1ull << 40) - 1)) * page_bytes;
+        // the mapping is private and read only, so the kernel reads the page again from the file if it is used
+        madvise(mapping.data + begin, std::min(page_bytes, mapping.size - begin), MADV_DONTNEED);
+    }
+}
+
+size_t TextureCache::ResidentBytes() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return resident.size() * page_bytes;
+}
+
+} // namespace RT
@@ -0,0 +1,58 @@
+#ifndef RT_TEXTURE_CACHE_H
+#define RT_TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RT {
+
+// Textures converted once to a tiled, mip-mapped file in a cache directory and memory mapped from there. The pages
+// of the files that lookups touch are counted against a memory budget, and the least recently used ones are
+// dropped from memory when it is exceeded. Dropped pages are read back from the file on the next access.
+class TextureCache {
+public:
+    static constexpr size_t page_bytes = 64 * 1024;
+
+    TextureCache(const std::string &directory, size_t budget);
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+    ~TextureCache();
+
+    // where the converted form of a texture file is kept, for textures decoded with the given gamma
+    [[nodiscard]] std::string CachePath(const std::string &texture_file, float gamma) const;
+
+    // map a converted file, returning its id for Touch()
+    int Map(const std::string &cache_file, const uint8_t *&data, size_t &size);
+
+    // mark the page holding byte `offset` of a mapped file as in use, before reading it
+    void Touch(int file, size_t offset);
+
+    // bytes of the pages counted as in memory
+    [[nodiscard]] size_t ResidentBytes() const;
+
+private:
+    void touch_locked(uint64_t key);
+
+    std::string directory;
+    size_t budget;
+    uint64_t id;  // tells the per-thread page tables of caches apart
+
+    struct Mapping {
+        uint8_t *data;
+        size_t size;
+    };
+    std::vector<Mapping> mappings;
+
+    // pages as file id << 40 | page index, the most recently used first
+    std::list<uint64_t> lru;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> resident;
+    mutable std::mutex mtx;
+};
+
+} // namespace RT
+
+#endif // RT_TEXTURE_CACHE_H
@@ -0,0 +1,54 @@
+#include <args.hxx>
+
+#include "utils/accumulation_buffer.h"
+#include "utils/debug.h"
+#include "utils/image.h"
+#include "utils/post_process.h"
+
+// merge the accumulation buffers written by `RT --shard i/N` into the final image
+int main(int argc, char *argv[]) {
+    google::InitGoogleLogging(argv[0]);
+    args::ArgumentParser parser("merge shards of a render");
+
+    args::HelpFlag help(parser, "HELP", "Show this help menu.", {"help"});
+    args::ValueFlag<std::string> output(parser, "output_file", "output file", {'o', "output"}, "output/output.bmp");
+    args::ValueFlag<float> exposure(parser, "exposure", "exposure of the output in stops", {"exposure"}, 0);
+    args::ValueFlag<std::string> tonemap(parser, "tonemap", "tone mapping of 8-bit output: none, reinhard or aces",
+                                         {"tonemap"}, "none");
+    args::Flag srgb(parser, "srgb", "encode 8-bit output with the sRGB curve instead of the scene gamma", {"srgb"});
+    args::PositionalList<std::string> shard_files(parser, "shards", "accumulation buffers to merge");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help&) {
+        std::cout << parser;
+        return 0;
+    }
+
+    const auto &files = args::get(shard_files);
+    if (files.empty()) {
+        LOG(FATAL) << "no shard to merge";
+    }
+    RT::AccumulationBuffer buffer = RT::AccumulationBuffer::Load(files[0]);
+    for (int i = 1; i < files.size(); i++) {
+        RT::AccumulationBuffer shard = RT::AccumulationBuffer::Load(files[i]);
+        if (shard.Gamma() != buffer.Gamma()) {
+            LOG(ERROR) << fmt::format("gamma of '{}' differs from '{}'", files[i], files[0]);
+        }
+        buffer.Merge(shard);
+    }
+
+    int num_empty = 0;
+    RT::Image img(buffer.Width(), buffer.Height());
+    for (int y = 0; y < buffer.Height(); y++) {
+        for (int x = 0; x < buffer.Width(); x++) {
+            num_empty += buffer.Count(x, y) == 0;
+            img.SetPixel(x, y, buffer.Mean(x, y));
+        }
+    }
+    if (num_empty > 0) {
+        LOG(ERROR) << fmt::format("{} pixels have no sample, some shards are missing?", num_empty);
+    }
+    LOG(ERROR) << fmt::format("merged {} shards into {}", files.size(), output.Get());
+    img.SaveImage(output.Get().c_str(), RT::PostProcess(buffer.Gamma(), exposure.Get(), tonemap.Get(), srgb.Get()));
+}
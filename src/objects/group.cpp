@@ -16,4 +16,10 @@ bool Group::Intersect(const Ray &r, Hit &h, float tmin) const {
     return is_intersect;
 }
 
+void Group::CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const {
+    for (const auto &obj: objects) {
+        obj->CollectEmitters(emitters);
+    }
+}
+
 } // namespace RT
\ No newline at end of file
@@ -22,6 +22,8 @@ public:
 
     bool Intersect(const Ray &r, Hit &h, float tmin) const override;
 
+    void CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const override;
+
     std::vector<std::unique_ptr<Object3D>> objects;
 
 private:
@@ -19,6 +19,12 @@ bool Mesh::Intersect(const Ray &r, Hit &h, float tmin) const {
     return bvh.Intersect(r, h, tmin);
 }
 
+void Mesh::CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const {
+    for (const Triangle &tri: triangles) {
+        tri.CollectEmitters(emitters);
+    }
+}
+
 Mesh::Mesh(
         const std::vector<Vector3f> &vs,
         const std::vector<Vector3f> &normals,
@@ -30,6 +30,8 @@ public:
 
     bool Intersect(const Ray &r, Hit &h, float tmin) const override;
 
+    void CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const override;
+
 private:
     size_t num_faces;
     std::vector<Triangle> triangles;
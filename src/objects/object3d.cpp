@@ -0,0 +1,41 @@
+#include <cmath>
+
+#include "core/material.h"
+#include "utils/math_util.h"
+#include "utils/debug.h"
+
+#include "./object3d.h"
+
+namespace RT {
+
+void SimpleObject3D::CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const {
+    if (material != nullptr && material->emissionColor != Vector3f::ZERO && Area() > 0) {
+        emitters.emplace_back(this);
+    }
+}
+
+Vector3f SimpleObject3D::SampleSurface(RNG &rng, Vector3f &normal) const {
+    CHECK(false) << "surface sampling not supported";
+    return Vector3f::ZERO;
+}
+
+float SimpleObject3D::SampleFrom(const Vector3f &ref, RNG &rng, Vector3f &point, Vector3f &normal) const {
+    point = SampleSurface(rng, normal);
+    return PdfFrom(ref, point, normal);
+}
+
+float SimpleObject3D::PdfFrom(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const {
+    // convert the area density 1 / A to solid angle density, emitters are two-sided
+    Vector3f to_point = point - ref;
+    float dist2 = to_point.squaredLength();
+    float cos_light = std::abs(Vector3f::dot(normal, to_point)) / std::sqrt(dist2);
+    if (cos_light < 1e-6f) return 0.f;
+    return dist2 / (cos_light * Area());
+}
+
+void SimpleObject3D::NormalBounds(Vector3f &axis, float &cos_theta) const {
+    axis = Vector3f(0, 0, 1);
+    cos_theta = -1;
+}
+
+} // namespace RT
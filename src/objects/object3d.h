@@ -1,6 +1,8 @@
 #ifndef OBJECT3D_H
 #define OBJECT3D_H
 
+#include <vector>
+
 #include "utils/aabb.h"
 
 namespace RT {
@@ -9,6 +11,8 @@ class Hit;
 class Material;
 class Texture;
 class Ray;
+class RNG;
+class SimpleObject3D;
 
 // Base class for all 3d entities.
 class Object3D {
@@ -18,7 +22,10 @@ public:
     // MayIntersect Ray with this object. If hit, store information in hit
     // structure.
     virtual bool Intersect(const Ray &r, Hit &h, float tmin) const = 0;
-    const AABB& GetBox() { return box; }
+    const AABB& GetBox() const { return box; }
+
+    // append all emissive objects that can be sampled as area lights
+    virtual void CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const {}
 
 protected:
     AABB box;
@@ -30,6 +37,23 @@ public:
 
     [[nodiscard]] const Material *GetMaterial() const { return material; }
 
+    void CollectEmitters(std::vector<const SimpleObject3D *> &emitters) const override;
+
+    // surface area, 0 if the object cannot be sampled (e.g. infinite plane)
+    [[nodiscard]] virtual float Area() const { return 0.f; }
+
+    // uniformly sample a point on the surface, only valid if Area() > 0
+    virtual Vector3f SampleSurface(RNG &rng, Vector3f &normal) const;
+
+    // sample a point on the surface seen from ref, return the density w.r.t. solid angle at ref
+    virtual float SampleFrom(const Vector3f &ref, RNG &rng, Vector3f &point, Vector3f &normal) const;
+
+    // density of SampleFrom() producing point
+    [[nodiscard]] virtual float PdfFrom(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const;
+
+    // a cone (axis, cos of spread angle) bounding the surface normals, all directions by default
+    virtual void NormalBounds(Vector3f &axis, float &cos_theta) const;
+
     const Material *material;
     const Texture *texture; // maybe nullptr, which means no texture for it
 };
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "core/ray.h"
 #include "core/hit.h"
 #include "core/texture.h"
@@ -42,11 +44,18 @@ bool Plane::Intersect(const Ray &r, Hit &hit, float tmin) const {
             auto y = (Vector3f::dot(hit_point, texture_up) + texture_translate.y()) / texture_scale;
             auto u = x - std::floor(x);
             auto v = y - std::floor(y);
+            // the texture coordinates are linear on the plane, so the footprint maps over directly
+            float width = 0;
+            Vector3f dpdx, dpdy;
+            if (r.Footprint(hit_point, normal, dpdx, dpdy)) {
+                width = std::max({std::abs(Vector3f::dot(dpdx, texture_right)), std::abs(Vector3f::dot(dpdx, texture_up)),
+                                  std::abs(Vector3f::dot(dpdy, texture_right)), std::abs(Vector3f::dot(dpdy, texture_up))}) / texture_scale;
+            }
             if (texture != nullptr) {
-                color = texture->At(u, v);
+                color = texture->At(u, v, width);
             }
             if (normal_texture != nullptr) {
-                auto texture_n = normal_texture->At(u, v);
+                auto texture_n = normal_texture->At(u, v, width);
                 true_normal = texture_n.x() * texture_up + texture_n.y() * texture_right + texture_n.z() * normal;
 //                fmt::print("true_normal: {}\n", true_normal);
             }
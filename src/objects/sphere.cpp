@@ -6,6 +6,7 @@
 #include "core/material.h"
 
 #include "utils/debug.h"
+#include "utils/math_util.h"
 #include "./sphere.h"
 
 namespace RT {
@@ -40,7 +41,13 @@ bool Sphere::Intersect(const Ray &r, Hit &h, float tmin) const {
                 Vector3f center_to_intersection = (hit_point - center).normalized();
                 float u = std::atan2(center_to_intersection.z(), center_to_intersection.x()) / (float) M_PI / 2.f + 0.5f;
                 float v = std::asin(center_to_intersection.y()) / (float) M_PI + 0.5f;
-                color = texture->At(u, v);
+                // u runs around the equator and v from pole to pole, ignoring the stretch near the poles
+                float width = 0;
+                Vector3f dpdx, dpdy;
+                if (r.Footprint(intersection, normal_at_intersection, dpdx, dpdy)) {
+                    width = std::max(dpdx.length(), dpdy.length()) / (radius * (float) M_PI);
+                }
+                color = texture->At(u, v, width);
             }
             h.Set(t, material, normal_at_intersection, intersection, color, this);
             return true;
@@ -50,4 +57,27 @@ bool Sphere::Intersect(const Ray &r, Hit &h, float tmin) const {
     }
 }
 
+float Sphere::Area() const {
+    return 4 * (float) M_PI * radius * radius;
+}
+
+Vector3f Sphere::SampleSurface(RNG &rng, Vector3f &normal) const {
+    normal = rng.RandNormalizedVector();
+    return center + radius * normal;
+}
+
+float Sphere::SampleFrom(const Vector3f &ref, RNG &rng, Vector3f &point, Vector3f &normal) const {
+    float pdf = sample_sphere_cone(ref, center, radius, rng, point);
+    if (pdf == 0) {  // inside the sphere, fallback to area sampling
+        return SimpleObject3D::SampleFrom(ref, rng, point, normal);
+    }
+    normal = (point - center).normalized();
+    return pdf;
+}
+
+float Sphere::PdfFrom(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const {
+    float pdf = sphere_cone_pdf(ref, center, radius);
+    return pdf > 0 ? pdf : SimpleObject3D::PdfFrom(ref, point, normal);
+}
+
 } // namespace RT
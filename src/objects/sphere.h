@@ -17,6 +17,11 @@ public:
 
     bool Intersect(const Ray &r, Hit &h, float tmin) const override;
 
+    [[nodiscard]] float Area() const override;
+    Vector3f SampleSurface(RNG &rng, Vector3f &normal) const override;
+    float SampleFrom(const Vector3f &ref, RNG &rng, Vector3f &point, Vector3f &normal) const override;
+    [[nodiscard]] float PdfFrom(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const override;
+
     const Vector3f center;
     const float radius;
 
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "utils/math_util.h"
 #include "utils/debug.h"
 
@@ -30,7 +32,21 @@ bool Triangle::Intersect(const Ray &r, Hit &h, float tmin) const {
         if (texture != nullptr) {
             CHECK(has_tex_coord);
             Vector2f uv = (1 - beta - gamma) * ta + beta * tb + gamma * tc;
-            color = texture->At(uv.x(), uv.y());
+            float width = 0;
+            Vector3f dpdx, dpdy;
+            if (r.Footprint(r.PointAtParameter(t), normal, dpdx, dpdy)) {
+                // barycentric offsets of the footprint, mapped to texture coordinates
+                Vector3f e1 = b - a, e2 = c - a;
+                float d11 = Vector3f::dot(e1, e1), d12 = Vector3f::dot(e1, e2), d22 = Vector3f::dot(e2, e2);
+                float inv_det = 1 / (d11 * d22 - d12 * d12);
+                for (const Vector3f &dp: {dpdx, dpdy}) {
+                    float p1 = Vector3f::dot(dp, e1), p2 = Vector3f::dot(dp, e2);
+                    float dbeta = (d22 * p1 - d12 * p2) * inv_det, dgamma = (d11 * p2 - d12 * p1) * inv_det;
+                    Vector2f duv = dbeta * (tb - ta) + dgamma * (tc - ta);
+                    width = std::max({width, std::abs(duv.x()), std::abs(duv.y())});
+                }
+            }
+            color = texture->At(uv.x(), uv.y(), width);
         }
         Vector3f true_normal = has_norm
                 ? (1 - beta - gamma) * na + beta * nb + gamma * nc
@@ -42,6 +58,28 @@ bool Triangle::Intersect(const Ray &r, Hit &h, float tmin) const {
     }
 }
 
+float Triangle::Area() const {
+    return Vector3f::cross(b - a, c - a).length() / 2;
+}
+
+Vector3f Triangle::SampleSurface(RNG &rng, Vector3f &n) const {
+    float su = std::sqrt(rng.RandUniformFloat());
+    float beta = su * rng.RandUniformFloat();
+    float gamma = 1 - su;
+    n = normal;
+    return (1 - beta - gamma) * a + beta * b + gamma * c;
+}
+
+float Triangle::PdfFrom(const Vector3f &ref, const Vector3f &point, const Vector3f &n) const {
+    // the normal of a hit may be interpolated, use the geometric one as SampleSurface() does
+    return SimpleObject3D::PdfFrom(ref, point, normal);
+}
+
+void Triangle::NormalBounds(Vector3f &axis, float &cos_theta) const {
+    axis = normal;
+    cos_theta = 1;
+}
+
 void Triangle::SetVertexNormal(const Vector3f &_na, const Vector3f &_nb, const Vector3f &_nc) {
     na = _na;
     nb = _nb;
@@ -15,6 +15,11 @@ public:
 
     bool Intersect(const Ray &r, Hit &h, float tmin) const override;
 
+    [[nodiscard]] float Area() const override;
+    Vector3f SampleSurface(RNG &rng, Vector3f &normal) const override;
+    [[nodiscard]] float PdfFrom(const Vector3f &ref, const Vector3f &point, const Vector3f &normal) const override;
+    void NormalBounds(Vector3f &axis, float &cos_theta) const override;
+
     void SetVertexNormal(const Vector3f &_na, const Vector3f &_nb, const Vector3f &_nc);
     void SetTextureCoord(const Vector2f &_ta, const Vector2f &_tb, const Vector2f &_tc);
 
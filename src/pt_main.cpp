@@ -1,7 +1,10 @@
+#include <cstdio>
+
 #include <args.hxx>
 
 #include "renderers/path_tracing.h"
 #include "utils/debug.h"
+#include "utils/post_process.h"
 #include "utils/scene_parser.h"
 
 int main(int argc, char *argv[]) {
@@ -14,6 +17,25 @@ int main(int argc, char *argv[]) {
 
     args::ValueFlag<int> subp(parser, "subp", "sub pixel", {'p', "subp"}, 1);
     args::ValueFlag<int> samples(parser, "samples", "samples", {'s', "samples"}, 1);
+    args::ValueFlag<int> max_depth(parser, "max-depth", "max depth of paths", {'d', "depth"}, 32);
+    args::ValueFlag<int> rr_depth(parser, "rr-depth", "depth to start russian roulette", {"rr-depth"}, 3);
+    args::ValueFlag<std::string> light_sampler(parser, "light-sampler", "choose lights by uniform, power or bvh",
+                                               {"light-sampler"}, "bvh");
+    args::ValueFlag<std::string> filter(parser, "filter", "pixel reconstruction filter: box, gaussian or mitchell",
+                                        {"filter"}, "box");
+    args::ValueFlag<std::string> shard(parser, "shard", "render shard i of N as i/N, the output is then an "
+                                                        "accumulation buffer for RT_merge", {"shard"}, "0/1");
+    args::ValueFlag<float> exposure(parser, "exposure", "exposure of the output in stops", {"exposure"}, 0);
+    args::ValueFlag<std::string> tonemap(parser, "tonemap", "tone mapping of 8-bit output: none, reinhard or aces",
+                                         {"tonemap"}, "none");
+    args::Flag aovs(parser, "aovs", "also save albedo, normal, depth, variance and sample count as "
+                                    "<output>_<name>.pfm", {"aovs"});
+    args::Flag denoise(parser, "denoise", "filter the output guided by albedo, normal and depth", {"denoise"});
+    args::Flag srgb(parser, "srgb", "encode 8-bit output with the sRGB curve instead of the scene gamma", {"srgb"});
+    args::ValueFlag<std::string> texture_cache(parser, "texture-cache", "map textures from tiled mip maps kept here",
+                                               {"texture-cache"}, "");
+    args::ValueFlag<int> texture_budget(parser, "texture-budget", "MB of mapped textures kept in memory",
+                                        {"texture-budget"}, 1024);
 
     try {
         parser.ParseCLI(argc, argv);
@@ -25,8 +47,21 @@ int main(int argc, char *argv[]) {
     LOG(ERROR) << fmt::format("input: {}, output: {}", input.Get(), output.Get());
 
     RT::SceneParser scene_parser;
+    if (!texture_cache.Get().empty()) {
+        scene_parser.SetTextureCache(texture_cache.Get(), (size_t) texture_budget.Get() << 20);
+    }
     scene_parser.parse(args::get(input));
 
-    RT::PathTracingRender renderer(args::get(subp), args::get(samples), scene_parser);
+    RT::PathTracingRender renderer(args::get(subp), args::get(samples), args::get(max_depth), args::get(rr_depth),
+                                   args::get(light_sampler), scene_parser);
+    int shard_index, num_shards;
+    if (std::sscanf(shard.Get().c_str(), "%d/%d", &shard_index, &num_shards) != 2) {
+        LOG(FATAL) << fmt::format("invalid shard '{}', should be i/N", shard.Get());
+    }
+    renderer.SetShard(shard_index, num_shards);
+    renderer.SetFilter(filter.Get());
+    renderer.SetAOVs(aovs.Get());
+    renderer.SetDenoise(denoise.Get());
+    renderer.SetPostProcess(RT::PostProcess(scene_parser.gamma, exposure.Get(), tonemap.Get(), srgb.Get()));
     renderer.Render(*scene_parser.scene, *scene_parser.camera, args::get(output));
 }
@@ -1,4 +1,7 @@
 #include "path_tracing.h"
+#include "utils/accumulation_buffer.h"
+#include "utils/denoiser.h"
+#include "utils/film.h"
 #include "utils/image.h"
 #include "utils/math_util.h"
 #include "utils/debug.h"
@@ -10,68 +13,222 @@
 
 namespace RT {
 
-PathTracingRender::PathTracingRender(int sub_pixel, int sub_sample, const SceneParser &parser) :
-sub_pixel(sub_pixel), sub_sample(sub_sample), gamma(parser.gamma), bg_color(parser.bg_color) {}
+PathTracingRender::PathTracingRender(int sub_pixel, int sub_sample, int max_depth, int rr_depth,
+                                     const std::string &light_sampler_name, const SceneParser &parser) :
+sub_pixel(sub_pixel), sub_sample(sub_sample), max_depth(max_depth), rr_depth(rr_depth),
+post(parser.gamma), bg_color(parser.bg_color), filter(Filter::Create("box")) {
+    for (const auto &light: parser.lights) {
+        lights.emplace_back(light.get());
+    }
+    for (const auto &light: parser.object_lights) {
+        lights.emplace_back(light.get());
+        emitter_lights[light->GetObject()] = light.get();
+    }
+    light_sampler = LightSampler::Create(light_sampler_name, lights);
+}
+
+void PathTracingRender::SetShard(int shard, int num_shards) {
+    CHECK(0 <= shard && shard < num_shards) << fmt::format("invalid shard {}/{}", shard, num_shards);
+    this->shard = shard;
+    this->num_shards = num_shards;
+}
+
+void PathTracingRender::SetAOVs(bool with_aovs) {
+    this->with_aovs = with_aovs;
+}
+
+void PathTracingRender::SetFilter(const std::string &filter_name) {
+    filter = Filter::Create(filter_name);
+}
+
+void PathTracingRender::SetDenoise(bool denoise) {
+    this->denoise = denoise;
+}
+
+void PathTracingRender::SetPostProcess(const PostProcess &post) {
+    this->post = post;
+}
 
 void PathTracingRender::Render(const Object3D &obj, const Camera &camera, const std::string &output_file) {
-    Image img(camera.getWidth(), camera.getHeight());
+    Film film(camera.getWidth(), camera.getHeight(), with_aovs || denoise);
+
+    // samples are numbered by sub pixel, then by sample inside the sub pixel, and a shard takes a range of them
+    const int num_samples = sub_pixel * sub_pixel * sub_sample;
+    const int first_sample = (int) ((long long) num_samples * shard / num_shards);
+    const int last_sample = (int) ((long long) num_samples * (shard + 1) / num_shards);
 
-    int ok_pixels = 0;
     ProgressBar bar("Path tracing", camera.getWidth() * camera.getHeight());
 
-#pragma omp parallel for collapse(2) schedule(dynamic, 4) shared(camera, img, obj, ok_pixels, bar) default(none)
-    for (int y = 0; y < camera.getHeight(); y++) {
-        for (int x = 0; x < camera.getWidth(); x++) {
-            // thread starting from here
-            RNG rng;
-            Vector3f pixel_color;
-            for (int sx = 0; sx < sub_pixel; sx++) {
-                for (int sy = 0; sy < sub_pixel; sy++) {
-                    float sub_x = (float) x + (float) sx / (float) sub_pixel;
-                    float sub_y = (float) y + (float) sy / (float) sub_pixel;
-                    for (int s = 0; s < sub_sample; s++) {
-                        float disturb_x = (1 + rng.RandTentFloat()) / (float) sub_pixel / 2;
-                        float disturb_y = (1 + rng.RandTentFloat()) / (float) sub_pixel / 2;
-                        Ray r = camera.generateRay(Vector2f(sub_x + disturb_x, sub_y + disturb_y), rng);
-                        Vector3f sample_color = trace(r, obj, 0, rng);
-                        pixel_color += sample_color;
-//                        LOG(ERROR) << fmt::format("cast ray ({}, {}) ({} -> {}) = {}", x, y, r.GetOrigin(),
-//                                                 r.GetDirection(), sample_color);
+    // each tile splats its samples into its own buffer, which is added to the film when the tile is done
+    const int tiles_x = (camera.getWidth() + tile_size - 1) / tile_size;
+    const int tiles_y = (camera.getHeight() + tile_size - 1) / tile_size;
+    // without a wider filter, a tent jitter inside the sub pixel does some anti-aliasing
+    const bool tent_jitter = dynamic_cast<const BoxFilter *>(filter.get()) != nullptr;
+    // the texture footprint of a sample shrinks as more samples cover the pixel
+    const float differential_scale = std::max(0.125f, 1 / std::sqrt((float) num_samples));
+
+#pragma omp parallel for collapse(2) schedule(dynamic) shared(camera, film, obj, bar, first_sample, last_sample, tiles_x, tiles_y, tent_jitter, differential_scale) default(none)
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            const int x0 = tx * tile_size, x1 = std::min(x0 + tile_size, camera.getWidth());
+            const int y0 = ty * tile_size, y1 = std::min(y0 + tile_size, camera.getHeight());
+            Film::Tile tile(x0, y0, x1, y1, *filter);
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    RNG rng;
+                    Film::Pixel pixel;
+                    for (int i = first_sample; i < last_sample; i++) {
+                        int sx = i / sub_sample / sub_pixel, sy = i / sub_sample % sub_pixel;
+                        float sub_x = (float) x + (float) sx / (float) sub_pixel;
+                        float sub_y = (float) y + (float) sy / (float) sub_pixel;
+                        float disturb_x, disturb_y;
+                        if (tent_jitter) {
+                            disturb_x = (1 + rng.RandTentFloat()) / (float) sub_pixel / 2;
+                            disturb_y = (1 + rng.RandTentFloat()) / (float) sub_pixel / 2;
+                        } else {
+                            disturb_x = rng.RandUniformFloat() / (float) sub_pixel;
+                            disturb_y = rng.RandUniformFloat() / (float) sub_pixel;
+                        }
+                        Vector2f pos(sub_x + disturb_x, sub_y + disturb_y);
+                        Ray r = camera.generateRay(pos, rng);
+                        r.ScaleDifferentials(differential_scale);
+                        Film::Feature feature;
+                        Vector3f radiance = trace(r, obj, rng, film.HasAOVs() ? &feature : nullptr);
+                        pixel.AddSplattedRadiance(radiance);
+                        tile.Splat(pos.x(), pos.y(), radiance);
+                        if (film.HasAOVs()) {
+                            pixel.AddFeature(feature);
+                        }
                     }
+                    film.AddPixel(x, y, pixel);
+                    bar.Step();
                 }
             }
-            pixel_color = gamma_correct(pixel_color / (float) sub_pixel / (float) sub_pixel / (float) sub_sample, gamma);
-            img.SetPixel(x, y, pixel_color);
-            bar.Step();
+            film.AddTile(tile);
         }
     }
 
-    img.SaveImage(output_file.c_str());
+    if (with_aovs) {
+        film.SaveAOVs(output_file.substr(0, output_file.rfind('.')));
+    }
+    if (num_shards > 1) {
+        if (denoise) {
+            LOG(ERROR) << "shards are saved without denoising";
+        }
+        AccumulationBuffer buffer(film.Width(), film.Height(), post.Gamma());
+        for (int y = 0; y < film.Height(); y++) {
+            for (int x = 0; x < film.Width(); x++) {
+                buffer.AddSamples(x, y, film.WeightedRadiance(x, y), film.Weight(x, y), film.Count(x, y));
+            }
+        }
+        buffer.Save(output_file);
+        return;
+    }
+    if (denoise) {
+        Image img(film.Width(), film.Height());
+        Denoiser().Denoise(film, img);
+        img.SaveImage(output_file.c_str(), post);
+    } else {
+        film.Save(output_file, post);
+    }
 }
 
-Vector3f PathTracingRender::trace(const Ray &ray, const Object3D &obj, int depth, RNG &rng) {
-    Hit hit;
-    bool is_hit = obj.Intersect(ray, hit, 0.0001);
-    if (!is_hit) {
-        return bg_color;
-    }
-    const Material *mat = hit.GetMaterial();
+Vector3f PathTracingRender::trace(const Ray &camera_ray, const Object3D &obj, RNG &rng, Film::Feature *feature) const {
+    Vector3f radiance = Vector3f::ZERO;
+    Vector3f throughput(1, 1, 1);  // attenuation from the camera to the origin of ray
+    Ray ray = camera_ray;
+    float bsdf_pdf = 0;  // density of sampling ray if direct lighting is sampled at its origin, otherwise 0
+    Vector3f bsdf_normal;  // normal at the origin of ray
 
-    if (depth >= 5) {
-        return mat->emissionColor;
+    for (int depth = 0; ; depth++) {
+        Hit hit;
+        bool is_hit = obj.Intersect(ray, hit, 0.0001);
+        if (!is_hit) {
+            radiance += throughput * bg_color;
+            break;
+        }
+        const Material *mat = hit.GetMaterial();
+        if (depth == 0 && feature != nullptr) {
+            feature->albedo = hit.GetAmbient();
+            feature->normal = hit.GetNormal();
+            feature->depth = hit.GetT() * ray.GetDirection().length();
+        }
+
+        // the emission might also be found by direct light sampling at the ray origin
+        Vector3f emission = mat->emissionColor;
+        if (bsdf_pdf > 0) {
+            emission = emission * power_heuristic(bsdf_pdf, light_pdf(ray.GetOrigin(), bsdf_normal, hit));
+        }
+        radiance += throughput * emission;
+
+        if (depth >= max_depth) {
+            break;
+        }
+
+        const Vector3f &hit_ambient = hit.GetAmbient();
+
+        if (mat->IsLambert()) {
+            radiance += throughput * hit_ambient * sample_direct_light(ray, hit, obj, rng);
+        }
+
+        Vector3f sample_dir = mat->Sample(ray, hit, rng);
+        Ray sample_ray = Ray(hit.GetPos(), sample_dir, ray.GetTime());
+        if (ray.HasDifferentials() && !mat->IsDiffuse()) {
+            sample_ray.PropagateSpecular(ray, hit.GetNormal(), mat->refraction);
+        }
+        float brdf = mat->BRDF(ray, sample_ray, hit);
+        bsdf_pdf = mat->IsLambert() ? mat->Pdf(ray, sample_ray.GetDirection(), hit) : 0.f;
+        bsdf_normal = hit.GetNormal();
+        throughput = throughput * hit_ambient * brdf;
+
+        // russian roulette: terminate paths carrying little energy, and compensate the survivors
+        if (depth >= rr_depth) {
+            float survive_prob = std::min(1.f, throughput.max_component());
+            if (rng.RandUniformFloat() >= survive_prob) {
+                break;
+            }
+            throughput = throughput / survive_prob;
+        }
+        ray = sample_ray;
     }
+    return radiance;
+}
 
-    const Vector3f &hit_ambient = hit.GetAmbient();
+Vector3f PathTracingRender::sample_direct_light(const Ray &ray, const Hit &hit, const Object3D &obj, RNG &rng) const {
+    float select_pdf;
+    const Light *light = light_sampler->Sample(hit.GetPos(), hit.GetNormal(), rng.RandUniformFloat(), select_pdf);
+    if (light == nullptr) {
+        return Vector3f::ZERO;
+    }
 
-    Vector3f hit_point = hit.GetPos();
+    LightSample ls = light->SampleLi(hit.GetPos(), rng);
+    if (ls.pdf <= 0) {
+        return Vector3f::ZERO;
+    }
+    const Material *mat = hit.GetMaterial();
+    float brdf_cos = mat->Eval(ray, ls.dir, hit);
+    if (brdf_cos <= 0) {
+        return Vector3f::ZERO;
+    }
 
-    Vector3f sample_dir = mat->Sample(ray, hit, rng);
-    Ray sample_ray = Ray(hit_point, sample_dir, ray.GetTime());
-    float brdf = mat->BRDF(ray, sample_ray, hit);
+    Hit shadow_hit(ls.dist * 0.999f);
+    if (obj.Intersect(Ray(hit.GetPos(), ls.dir, ray.GetTime()), shadow_hit, 0.0001)) {
+        return Vector3f::ZERO;  // occluded
+    }
 
-    Vector3f sample_ray_color = trace(sample_ray, obj, depth + 1, rng);
+    float pdf = ls.pdf * select_pdf;
+    // a light that rays cannot hit has no BSDF sampling strategy to share its contribution with
+    float weight = ls.hittable ? power_heuristic(pdf, mat->Pdf(ray, ls.dir, hit)) : 1.f;
+    return ls.radiance * (brdf_cos * weight / pdf);
+}
 
-    return mat->emissionColor + hit_ambient * sample_ray_color * brdf;
+float PathTracingRender::light_pdf(const Vector3f &ref, const Vector3f &ref_normal, const Hit &hit) const {
+    auto it = emitter_lights.find(hit.GetObject());
+    if (it == emitter_lights.end()) {
+        return 0.f;
+    }
+    const Light *light = it->second;
+    return light->PdfLi(ref, hit.GetPos(), hit.GetNormal()) * light_sampler->Pmf(ref, ref_normal, light);
 }
 
 } // namespace RT
@@ -1,9 +1,17 @@
 #ifndef RT_PATH_TRACING_H
 #define RT_PATH_TRACING_H
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "core/camera.h"
+#include "core/light.h"
+#include "core/light_sampler.h"
+#include "utils/film.h"
+#include "utils/filter.h"
+#include "utils/post_process.h"
 #include "utils/scene_parser.h"
 #include "objects/object3d.h"
 
@@ -13,15 +21,54 @@ class RNG;
 
 class PathTracingRender {
 public:
-    PathTracingRender(int sub_pixel, int sub_sample, const SceneParser &parser);
+    // paths longer than rr_depth are terminated by russian roulette, and no path is longer than max_depth
+    // light_sampler_name: strategy of choosing a light for direct lighting, see LightSampler::Create()
+    PathTracingRender(int sub_pixel, int sub_sample, int max_depth, int rr_depth,
+                      const std::string &light_sampler_name, const SceneParser &parser);
+
+    // render only the samples [shard * n / num_shards, (shard + 1) * n / num_shards) of each pixel,
+    // and save them as an AccumulationBuffer instead of an image, see merge_main.cpp
+    void SetShard(int shard, int num_shards);
+
+    // exposure, tone mapping and encoding of the output image, by default only the gamma of the scene
+    void SetPostProcess(const PostProcess &post);
+
+    // also save first-hit albedo, normal and depth, variance and sample count, see Film::SaveAOVs()
+    void SetAOVs(bool with_aovs);
+
+    // reconstruction filter of the pixels, see Filter::Create()
+    void SetFilter(const std::string &filter_name);
+
+    // filter the output with Denoiser guided by the AOVs
+    void SetDenoise(bool denoise);
 
     void Render(const Object3D &obj, const Camera &camera, const std::string &output_file);
 
 private:
-    Vector3f trace(const Ray &ray, const Object3D &obj, int depth, RNG &rng);
+    // radiance along a camera ray, the path is extended iteratively with accumulated throughput
+    // feature: if not null, set to what the camera ray hits first
+    Vector3f trace(const Ray &camera_ray, const Object3D &obj, RNG &rng, Film::Feature *feature = nullptr) const;
+
+    // radiance from a randomly chosen light, with MIS weight against BSDF sampling
+    Vector3f sample_direct_light(const Ray &ray, const Hit &hit, const Object3D &obj, RNG &rng) const;
+
+    // density of sample_direct_light() at ref choosing the hit point on an emissive object
+    float light_pdf(const Vector3f &ref, const Vector3f &ref_normal, const Hit &hit) const;
+
+    static constexpr int tile_size = 16;
+
     int sub_pixel, sub_sample;
-    float gamma;
+    int max_depth, rr_depth;
+    int shard = 0, num_shards = 1;
+    bool with_aovs = false;
+    bool denoise = false;
+    PostProcess post;
     Vector3f bg_color;
+
+    std::vector<const Light *> lights;
+    std::unordered_map<const SimpleObject3D *, const Light *> emitter_lights;
+    std::unique_ptr<LightSampler> light_sampler;
+    std::unique_ptr<Filter> filter;
 };
 
 } // namespace RT
@@ -1,7 +1,21 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "utils/prog_bar.hpp"
 #include "utils/image.h"
 #include "utils/math_util.h"
 #include "utils/debug.h"
+#include "utils/denoiser.h"
 
 #include "core/camera.h"
 #include "core/ray.h"
@@ -9,21 +23,85 @@
 
 #include "./photon_mapping.h"
 
+extern "C" char **environ;
+
 namespace RT {
 
+namespace {
+
+// records of the files exchanged between the SPPM coordinator and its workers
+struct VisiblePointRecord {
+    int index;
+    float center[3];
+    float radius;
+};
+
+struct PhotonStatsRecord {
+    int index;
+    int num_photons;
+    float power[3];
+};
+
+// written aside and renamed, the reader waits for the file to appear and never sees it half written
+template<typename T>
+void write_records(const std::string &file_name, int header, const std::vector<T> &records) {
+    const std::string tmp_name = file_name + ".tmp";
+    {
+        std::ofstream file(tmp_name, std::ios::binary);
+        int num_records = (int) records.size();
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&num_records), sizeof(num_records));
+        file.write(reinterpret_cast<const char *>(records.data()), (std::streamsize) (records.size() * sizeof(T)));
+        if (!file) {
+            throw std::runtime_error(fmt::format("failed to write '{}'", file_name));
+        }
+    }
+    std::filesystem::rename(tmp_name, file_name);
+}
+
+template<typename T>
+std::vector<T> read_records(const std::string &file_name, int &header) {
+    std::ifstream file(file_name, std::ios::binary);
+    int num_records = 0;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&num_records), sizeof(num_records));
+    std::vector<T> records(std::max(num_records, 0));
+    file.read(reinterpret_cast<char *>(records.data()), (std::streamsize) (records.size() * sizeof(T)));
+    if (!file) {
+        throw std::runtime_error(fmt::format("failed to read '{}'", file_name));
+    }
+    return records;
+}
+
+} // anonymous namespace
+
+void VisiblePoints::Resize(int size, float init_radius) {
+    center.assign(size, Vector3f::ZERO);
+    radius.assign(size, init_radius);
+    round_power.assign(size, Vector3f::ZERO);
+    round_photons.assign(size, 0);
+    forward_flux.assign(size, Vector3f::ZERO);
+    attenuation.assign(size, Vector3f(1, 1, 1));
+    is_valid.assign(size, false);
+    photon_flux.assign(size, Vector3f::ZERO);
+    num_photons.assign(size, 0);
+}
+
 PhotonMappingRender::PhotonMappingRender(
         float alpha,
         float init_radius,
         int num_rounds,
         int photons_per_round,
         int vp_per_pixel,
+        const std::string &backend,
+        bool guide_emission,
         const SceneParser &scene_parser
         ) :
-        gamma(scene_parser.gamma),
         obj(scene_parser.scene.get()),
         camera(scene_parser.camera.get()),
-        lights(scene_parser.lights),
         bg_color(scene_parser.bg_color),
+        lights(scene_parser.lights),
+        post(scene_parser.gamma),
         alpha(alpha),
         init_radius(init_radius),
         num_rounds(num_rounds),
@@ -33,93 +111,447 @@ PhotonMappingRender::PhotonMappingRender(
         {
     width = camera->getWidth();
     height = camera->getHeight();
+    CHECK(vp_per_pixel >= 1) << "at least one visible point per pixel";
+    if (backend == "grid") {
+        this->backend = Backend::Grid;
+    } else if (backend == "grid-batched") {
+        this->backend = Backend::BatchedGrid;
+    } else if (backend == "kdtree") {
+        this->backend = Backend::KdTree;
+    } else {
+        throw std::runtime_error(fmt::format("unknown SPPM backend '{}'", backend));
+    }
+
+    std::vector<float> light_powers;
+    for (const auto &light: lights) {
+        light_powers.emplace_back(luminance(light->Power()));
+    }
+    light_table = AliasTable(light_powers);
+
+    // the emission is guided by which photons reach visible points, only known right away with the grid backend
+    if (guide_emission && this->backend != Backend::Grid) {
+        throw std::runtime_error("photon emission guiding requires the grid backend");
+    }
+    for (const auto &light: lights) {
+        emission_guides.emplace_back(guide_emission && light->IsIsotropic() ? std::make_unique<DirectionGuide>() : nullptr);
+    }
 }
 
 void PhotonMappingRender::Render(const std::string &output_file) {
-    visible_point_map.resize(width * height);
+    CHECK(!lights.empty()) << "no light to emit photons";
+    const int num_vps = width * height * vp_per_pixel;
+    visible_points.Resize(num_vps, init_radius);
     img_data.resize(width * height);
-    size_t photons_per_light = photons_per_round / lights.size();
-    size_t true_photons_per_round = photons_per_light * lights.size();
+    Film film(width, height, with_aovs || denoise);
+    // every round adds vp_per_pixel samples to a pixel, shrinking the texture footprint of each
+    const float differential_scale = std::max(0.125f, 1 / std::sqrt((float) (vp_per_pixel * num_rounds)));
 
     for (int r = 0; r < num_rounds; r++) {
         ProgressBar bar_forward(fmt::format("Forward round {}", r + 1), width * height);
-#pragma omp parallel for schedule(dynamic, 4) collapse(2) default(none) shared(bar_forward)
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                RNG per_thread_rng;
-                Ray ray = camera->generateRay({
-                        (float) x + 0.5f + 0.5f * per_thread_rng.RandTentFloat(),
-                        (float) y + 0.5f + 0.5f * per_thread_rng.RandTentFloat()
-                }, per_thread_rng);
-                // modifies vp, ball_finder
-                auto &vp = visible_point_map[y * width + x] = VisiblePoint();
-                trace_visible_point(vp, ray, per_thread_rng, 0);
-                if (vp.radius > 0) {
-#pragma omp critical
-                    ball_finder.AddBall(&vp);
+#pragma omp parallel default(none) shared(bar_forward, film, differential_scale)
+        {
+            // stratum permutation of the pixel, allocated once per thread
+            std::vector<int> perm(vp_per_pixel);
+#pragma omp for schedule(dynamic, 4) collapse(2)
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    RNG per_thread_rng;
+                    // latin hypercube over sub-pixel strata: visible point k takes x stratum k and y stratum perm[k]
+                    Film::Pixel aov_pixel;
+                    for (int k = 0; k < vp_per_pixel; k++) {
+                        int j = std::min((int) (per_thread_rng.RandUniformFloat() * (float) (k + 1)), k);
+                        perm[k] = perm[j];
+                        perm[j] = k;
+                    }
+                    for (int k = 0; k < vp_per_pixel; k++) {
+                        float disturb_x = (1 + per_thread_rng.RandTentFloat()) / 2, disturb_y = (1 + per_thread_rng.RandTentFloat()) / 2;
+                        Ray ray = camera->generateRay({
+                                (float) x + ((float) k + disturb_x) / (float) vp_per_pixel,
+                                (float) y + ((float) perm[k] + disturb_y) / (float) vp_per_pixel
+                        }, per_thread_rng);
+                        ray.ScaleDifferentials(differential_scale);
+                        // modifies vp, the radius and photon statistics are kept
+                        int vp = (y * width + x) * vp_per_pixel + k;
+                        visible_points.forward_flux[vp] = Vector3f::ZERO;
+                        visible_points.attenuation[vp] = Vector3f(1, 1, 1);
+                        visible_points.is_valid[vp] = false;
+                        Film::Feature feature;
+                        trace_visible_point(vp, ray, per_thread_rng, 0, film.HasAOVs() ? &feature : nullptr);
+                        img_data[y * width + x] += visible_points.forward_flux[vp] / (float) vp_per_pixel;
+                        aov_pixel.AddFeature(feature);
+                    }
+                    if (film.HasAOVs()) {
+                        film.AddPixel(x, y, aov_pixel);
+                    }
+                    bar_forward.Step();
                 }
-                bar_forward.Step();
             }
         }
+        if (backend != Backend::KdTree && num_workers == 0) {
+            // grid of all visible points that hit a diffuse surface
+            ball_finder.Build(visible_points.center.data(), visible_points.radius.data(), num_vps, [this](int vp) {
+                return visible_points.is_valid[vp];
+            });
+        }
 
-        ProgressBar bar_back(fmt::format("Back round {}", r + 1), true_photons_per_round);
-#pragma omp parallel for schedule(dynamic, 20) collapse(2) default(none) shared(bar_back, photons_per_light)
-        for (int l = 0; l < lights.size(); l++) {
-            for (int p = 0; p < photons_per_light; p++) {
-                RNG per_thread_rng;
-                auto ray = lights[l]->EmitRay(per_thread_rng);
-                // modifies some vp
-                trace_photon(ray, per_thread_rng, 0);
-                bar_back.Step();
+        if (num_workers > 0) {
+            run_workers(r);
+        } else if (backend == Backend::Grid) {
+            ProgressBar bar_back(fmt::format("Back round {}", r + 1), photons_per_round);
+            trace_photons(photons_per_round, bar_back);
+        } else {
+            // trace a batch of photons first, then deposit them in one go
+            // the kd-tree needs all photons of the round at once
+            ProgressBar bar_back(fmt::format("Back round {}", r + 1), photons_per_round);
+            int batch_size = backend == Backend::KdTree ? photons_per_round : photon_batch_size;
+            for (int first = 0; first < photons_per_round; first += batch_size) {
+                trace_photon_batch(std::min(batch_size, photons_per_round - first), bar_back);
+                if (backend == Backend::KdTree) {
+                    photon_tree.Build(photon_pos.data(), (int) photon_pos.size());
+#pragma omp parallel for schedule(dynamic, 64) default(none) shared(num_vps)
+                    for (int i = 0; i < num_vps; i++) {
+                        gather_photons(i);
+                    }
+                    photon_tree.Reset();
+                } else {
+                    deposit_photon_batch();
+                }
+                photon_pos.clear();
+                photon_power.clear();
+                photon_dir.clear();
             }
         }
         ball_finder.Reset();
 
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                VisiblePoint &vp = visible_point_map[y * width + x];
-                Vector3f photon_color = vp.photon_flux / ((float) M_PI * fsquare(vp.radius) * (float) photons_per_round);
-                Vector3f color = photon_color + vp.forward_flux;
-                img_data[y * width + x] += color;
-            }
+#pragma omp parallel for schedule(static) default(none) shared(num_vps)
+        for (int i = 0; i < num_vps; i++) {
+            progressive_update(i);
+        }
+        for (auto &guide: emission_guides) {
+            if (guide != nullptr) guide->Update();
         }
     }
 
-    Image img(width, height);
+    const float num_emitted = (float) num_rounds * (float) photons_per_round;
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
-            Vector3f color = img_data[y * width + x] / (float) num_rounds;
-            img.SetPixel(x, y, gamma_correct(color, gamma));
+            Vector3f photon_color = Vector3f::ZERO;
+            for (int vp = (y * width + x) * vp_per_pixel; vp < (y * width + x + 1) * vp_per_pixel; vp++) {
+                photon_color += visible_points.photon_flux[vp] / ((float) M_PI * fsquare(visible_points.radius[vp]) * num_emitted);
+            }
+            Vector3f color = img_data[y * width + x] / (float) num_rounds + photon_color / (float) vp_per_pixel;
+            Film::Pixel pixel;
+            pixel.AddRadiance(color);
+            film.AddPixel(x, y, pixel);
         }
     }
-    img.SaveImage(output_file.c_str());
+    if (with_aovs) {
+        // a pixel is a single estimate from all rounds, there are no per-sample statistics
+        film.SaveAOVs(output_file.substr(0, output_file.rfind('.')), false);
+    }
+    if (denoise) {
+        Image img(film.Width(), film.Height());
+        Denoiser().Denoise(film, img);
+        img.SaveImage(output_file.c_str(), post);
+    } else {
+        film.Save(output_file, post);
+    }
+}
+
+void PhotonMappingRender::SetAOVs(bool with_aovs) {
+    this->with_aovs = with_aovs;
 }
 
-void PhotonMappingRender::trace_visible_point(VisiblePoint &vp, const Ray &ray, RNG &rng, int depth) {
+void PhotonMappingRender::SetDenoise(bool denoise) {
+    this->denoise = denoise;
+}
+
+void PhotonMappingRender::SetPostProcess(const PostProcess &post) {
+    this->post = post;
+}
+
+void PhotonMappingRender::SetWorkers(int num_workers, const std::string &shard_dir,
+                                     const std::vector<std::string> &worker_command) {
+    if (backend != Backend::Grid || std::any_of(emission_guides.begin(), emission_guides.end(),
+                                                [](const auto &guide) { return guide != nullptr; })) {
+        throw std::runtime_error("worker processes only support the grid backend without guiding");
+    }
+    this->num_workers = num_workers;
+    this->shard_dir = shard_dir;
+    this->worker_command = worker_command;
+    std::filesystem::create_directories(shard_dir);
+}
+
+void PhotonMappingRender::RunWorker(const std::string &shard_dir, int worker, int num_workers) {
+    if (num_workers <= worker) {
+        throw std::runtime_error(fmt::format("worker {} of {} workers", worker, num_workers));
+    }
+    // the worker lives for all rounds, so the scene is loaded once
+    const pid_t coordinator = getppid();
+    for (int round = 0; round < num_rounds; round++) {
+        // the coordinator renames the visible points of a round into place once they are complete
+        while (!std::filesystem::exists(vp_file(shard_dir, round))) {
+            if (getppid() != coordinator) {
+                throw std::runtime_error(fmt::format("worker {}: the coordinator exited", worker));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        int num_vps;
+        auto vp_records = read_records<VisiblePointRecord>(vp_file(shard_dir, round), num_vps);
+        CHECK(num_vps == width * height * vp_per_pixel) << "visible points do not match the scene";
+        visible_points.Resize(num_vps, init_radius);
+        for (const auto &record: vp_records) {
+            visible_points.center[record.index] = Vector3f(record.center[0], record.center[1], record.center[2]);
+            visible_points.radius[record.index] = record.radius;
+            visible_points.is_valid[record.index] = true;
+        }
+        ball_finder.Build(visible_points.center.data(), visible_points.radius.data(), num_vps, [this](int vp) {
+            return visible_points.is_valid[vp];
+        });
+
+        // photons [first, last) of the round
+        int first = (int) ((long long) photons_per_round * worker / num_workers);
+        int last = (int) ((long long) photons_per_round * (worker + 1) / num_workers);
+        ProgressBar bar(fmt::format("Back round {} worker {}/{}", round + 1, worker, num_workers), last - first);
+        trace_photons(last - first, bar);
+        ball_finder.Reset();
+
+        std::vector<PhotonStatsRecord> stats_records;
+        for (const auto &record: vp_records) {
+            int vp = record.index;
+            if (visible_points.round_photons[vp] == 0) continue;
+            const Vector3f &power = visible_points.round_power[vp];
+            stats_records.push_back({vp, visible_points.round_photons[vp], {power.x(), power.y(), power.z()}});
+        }
+        write_records(stats_file(shard_dir, round, worker), num_vps, stats_records);
+    }
+}
+
+// start the workers once for all rounds, splitting the threads of this process among them
+void PhotonMappingRender::start_workers() {
+    remove_exchange_files();
+    const char *omp_threads = std::getenv("OMP_NUM_THREADS");
+    int threads = omp_threads != nullptr ? std::atoi(omp_threads) : (int) std::thread::hardware_concurrency();
+    std::vector<std::string> env;
+    for (char **e = environ; *e != nullptr; e++) {
+        if (std::strncmp(*e, "OMP_NUM_THREADS=", 16) != 0) {
+            env.emplace_back(*e);
+        }
+    }
+    env.emplace_back(fmt::format("OMP_NUM_THREADS={}", std::max(1, threads / num_workers)));
+    std::vector<char *> envp;
+    for (auto &var: env) {
+        envp.emplace_back(var.data());
+    }
+    envp.emplace_back(nullptr);
+
+    for (int i = 0; i < num_workers; i++) {
+        std::vector<std::string> args = worker_command;
+        args.insert(args.end(), {"--worker", std::to_string(i)});
+        std::vector<char *> argv;
+        for (auto &arg: args) {
+            argv.emplace_back(arg.data());
+        }
+        argv.emplace_back(nullptr);
+        pid_t pid;
+        if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), envp.data()) != 0) {
+            stop_workers();
+            throw std::runtime_error(fmt::format("failed to start worker {}", i));
+        }
+        worker_pids.emplace_back(pid);
+    }
+}
+
+// after an error, end the workers still running and remove the files they would have read or written
+void PhotonMappingRender::stop_workers() {
+    for (pid_t pid: worker_pids) {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+    worker_pids.clear();
+    remove_exchange_files();
+}
+
+void PhotonMappingRender::remove_exchange_files() const {
+    std::error_code ec;
+    for (int round = 0; round < num_rounds; round++) {
+        std::filesystem::remove(vp_file(shard_dir, round), ec);
+        std::filesystem::remove(vp_file(shard_dir, round) + ".tmp", ec);
+        for (int i = 0; i < num_workers; i++) {
+            std::filesystem::remove(stats_file(shard_dir, round, i), ec);
+            std::filesystem::remove(stats_file(shard_dir, round, i) + ".tmp", ec);
+        }
+    }
+}
+
+// hand the visible points of this round to the workers, and merge their photon statistics
+void PhotonMappingRender::run_workers(int round) {
+    if (round == 0) {
+        start_workers();
+    }
+    const int num_vps = width * height * vp_per_pixel;
+    std::vector<VisiblePointRecord> vp_records;
+    for (int vp = 0; vp < num_vps; vp++) {
+        if (!visible_points.is_valid[vp]) continue;
+        const Vector3f &c = visible_points.center[vp];
+        vp_records.push_back({vp, {c.x(), c.y(), c.z()}, visible_points.radius[vp]});
+    }
+    write_records(vp_file(shard_dir, round), num_vps, vp_records);
+
+    // wait for the statistics of every worker, a worker exiting before it wrote them has failed
+    for (int i = 0; i < num_workers; i++) {
+        while (!std::filesystem::exists(stats_file(shard_dir, round, i))) {
+            int status;
+            if (waitpid(worker_pids[i], &status, WNOHANG) == worker_pids[i]) {
+                worker_pids.erase(worker_pids.begin() + i);
+                stop_workers();
+                throw std::runtime_error(fmt::format("worker {} failed in round {}", i, round + 1));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        int header;
+        for (const auto &record: read_records<PhotonStatsRecord>(stats_file(shard_dir, round, i), header)) {
+            visible_points.round_power[record.index] += Vector3f(record.power[0], record.power[1], record.power[2]);
+            visible_points.round_photons[record.index] += record.num_photons;
+        }
+        std::filesystem::remove(stats_file(shard_dir, round, i));
+    }
+    std::filesystem::remove(vp_file(shard_dir, round));
+
+    if (round == num_rounds - 1) {
+        for (int i = 0; i < num_workers; i++) {
+            int status;
+            waitpid(worker_pids[i], &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                throw std::runtime_error(fmt::format("worker {} failed after the last round", i));
+            }
+        }
+        worker_pids.clear();
+    }
+}
+
+std::string PhotonMappingRender::vp_file(const std::string &shard_dir, int round) {
+    return fmt::format("{}/round-{}.vp", shard_dir, round);
+}
+
+std::string PhotonMappingRender::stats_file(const std::string &shard_dir, int round, int worker) {
+    return fmt::format("{}/round-{}-worker-{}.stats", shard_dir, round, worker);
+}
+
+// trace photons and deposit each of them right away, used by the grid backend
+void PhotonMappingRender::trace_photons(int num_photons, ProgressBar &bar) {
+#pragma omp parallel default(none) shared(num_photons, bar)
+    {
+        std::vector<Photon> photons;
+#pragma omp for schedule(dynamic, 20)
+        for (int p = 0; p < num_photons; p++) {
+            RNG per_thread_rng;
+            int l;
+            ColoredRay photon = emit_photon(per_thread_rng, l);
+            photons.clear();
+            trace_photon(photon, per_thread_rng, 0, photons);
+            // modifies some vp
+            int num_vps_found = 0;
+            for (const auto &hit: photons) {
+                num_vps_found += update_nearby_vp(hit.pos, hit.power);
+            }
+            if (num_vps_found > 0 && emission_guides[l] != nullptr) {
+                emission_guides[l]->Record(photon.GetDirection(), 1);
+            }
+            bar.Step();
+        }
+    }
+}
+
+// emit a photon from a light chosen in proportion to its power
+// with guiding, isotropic lights emit from the learned direction distribution instead
+ColoredRay PhotonMappingRender::emit_photon(RNG &rng, int &light) const {
+    light = light_table.Sample(rng.RandUniformFloat());
+    float pmf = light_table.Pmf(light);
+    const DirectionGuide *guide = emission_guides[light].get();
+    if (guide == nullptr) {
+        auto ray = lights[light]->EmitRay(rng);
+        return {ray, ray.GetColor() / pmf, ray.GetTime()};
+    }
+    float pdf;
+    Vector3f dir = guide->Sample(rng, pdf);
+    auto ray = lights[light]->EmitRayTowards(dir, rng);
+    // the light itself emits with density 1 / 4pi
+    return {ray, ray.GetColor() / (pmf * 4 * (float) M_PI * pdf), ray.GetTime()};
+}
+
+// trace photons into thread-local buffers, then append the buffers to photon_pos, photon_power and photon_dir
+void PhotonMappingRender::trace_photon_batch(int num_photons, ProgressBar &bar) {
+#pragma omp parallel default(none) shared(num_photons, bar)
+    {
+        std::vector<Photon> photons;
+#pragma omp for schedule(dynamic, 20)
+        for (int p = 0; p < num_photons; p++) {
+            RNG per_thread_rng;
+            int l;
+            trace_photon(emit_photon(per_thread_rng, l), per_thread_rng, 0, photons);
+            bar.Step();
+        }
+#pragma omp critical
+        for (const auto &photon: photons) {
+            photon_pos.emplace_back(photon.pos);
+            photon_power.emplace_back(photon.power);
+            photon_dir.emplace_back(photon.dir);
+        }
+    }
+}
+
+// deposit the photons cell by cell, each thread takes whole cells and updates the same few visible points in a row
+// a visible point near a cell border is also reached from the neighbouring cells, so the updates stay atomic
+void PhotonMappingRender::deposit_photon_batch() {
+    std::vector<uint32_t> cell_start;
+    std::vector<int> order = ball_finder.QueryOrder(photon_pos.data(), (int) photon_pos.size(), cell_start);
+    const int num_cells = (int) cell_start.size() - 1;
+#pragma omp parallel for schedule(dynamic, 256) default(none) shared(order, cell_start, num_cells)
+    for (int cell = 0; cell < num_cells; cell++) {
+        for (uint32_t i = cell_start[cell]; i < cell_start[cell + 1]; i++) {
+            update_nearby_vp(photon_pos[order[i]], photon_power[order[i]]);
+        }
+    }
+}
+
+void PhotonMappingRender::trace_visible_point(int vp, const Ray &ray, RNG &rng, int depth, Film::Feature *feature) {
     if (depth > 10) return;
 
     Hit hit;
     bool is_hit = obj->Intersect(ray, hit, 0.0001);
+    if (is_hit && depth == 0 && feature != nullptr) {
+        feature->albedo = hit.GetAmbient();
+        feature->normal = hit.GetNormal();
+        feature->depth = hit.GetT() * ray.GetDirection().length();
+    }
+    Vector3f &attenuation = visible_points.attenuation[vp];
     if (!is_hit) {
-        vp.forward_flux = vp.attenuation * bg_color;
+        visible_points.forward_flux[vp] = attenuation * bg_color;
         return;
     }
-    vp.attenuation = vp.attenuation * hit.GetAmbient();
+    attenuation = attenuation * hit.GetAmbient();
     const Material *mat = hit.GetMaterial();
 
     if (mat->IsDiffuse()) {
-        vp.forward_flux = vp.attenuation * mat->emissionColor;
-        vp.center = hit.GetPos();
-        vp.radius = init_radius;
+        visible_points.forward_flux[vp] = attenuation * mat->emissionColor;
+        visible_points.center[vp] = hit.GetPos();
+        visible_points.is_valid[vp] = true;
         return;
     } else {
         auto ray_out_dir = mat->Sample(ray, hit, rng);
         Ray out_ray(hit.GetPos(), ray_out_dir, ray.GetTime());
+        if (ray.HasDifferentials()) {
+            out_ray.PropagateSpecular(ray, hit.GetNormal(), mat->refraction);
+        }
         trace_visible_point(vp, out_ray, rng, depth + 1);
     }
 }
 
-void PhotonMappingRender::trace_photon(const ColoredRay &ray, RNG &rng, int depth) {
+void PhotonMappingRender::trace_photon(const ColoredRay &ray, RNG &rng, int depth, std::vector<Photon> &photons) {
     if (depth > 20) return;
 
     Hit hit;
@@ -130,24 +562,64 @@ void PhotonMappingRender::trace_photon(const ColoredRay &ray, RNG &rng, int dept
     Vector3f hit_ambient = hit.GetAmbient();
 
     if (mat->IsDiffuse()) {
-        update_nearby_vp(hit.GetPos(), ray.GetColor());
+        photons.push_back({hit.GetPos(), ray.GetColor(), ray.GetDirection().normalized()});
         if (depth > 5 && rng.RandUniformFloat() < hit_ambient.max_component()) {
             return;
         }
     }
     auto ray_out_dir = mat->Sample(ray, hit, rng);
     ColoredRay out_ray(hit.GetPos(), ray_out_dir, hit_ambient * ray.GetColor(), ray.GetTime());
-    trace_photon(out_ray, rng, depth + 1);
+    trace_photon(out_ray, rng, depth + 1, photons);
+}
+
+// returns the number of visible points found
+int PhotonMappingRender::update_nearby_vp(const Vector3f &pos, const Vector3f &attenuation) {
+    int num_found = 0;
+    ball_finder.FindAndOperateBalls(pos, [&](int vp) {
+        num_found++;
+        // radii are fixed during a round, so the set of photons a visible point receives does not depend on
+        // their order; the float sums still add in thread order, so they may differ in the last bits between runs
+        // the attenuation of the visible point is applied once per round
+        Vector3f &power = visible_points.round_power[vp];
+#pragma omp atomic
+        power[0] += attenuation[0];
+#pragma omp atomic
+        power[1] += attenuation[1];
+#pragma omp atomic
+        power[2] += attenuation[2];
+#pragma omp atomic
+        visible_points.round_photons[vp]++;
+    });
+    return num_found;
 }
 
-void PhotonMappingRender::update_nearby_vp(const Vector3f &pos, const Vector3f &attenuation) {
-    ball_finder.FindAndOperateBalls(pos, [&, this](VisiblePoint *vp) {
-        std::unique_lock<std::mutex> lk(*vp->mtx);
-        float radius_factor = ((float) vp->num_photons * alpha + alpha) / ((float) vp->num_photons * alpha + 1);
-        vp->num_photons++;
-        vp->photon_flux = (vp->photon_flux + vp->attenuation * attenuation / M_PI) * radius_factor;
-        vp->radius *= std::sqrt(radius_factor);
+// sum the photons within the radius of a visible point, used by the kd-tree backend
+void PhotonMappingRender::gather_photons(int vp) {
+    if (!visible_points.is_valid[vp]) return;
+    Vector3f power = Vector3f::ZERO;
+    int num_photons = 0;
+    photon_tree.FindInRadius(visible_points.center[vp], visible_points.radius[vp], [&](int p) {
+        power += photon_power[p];
+        num_photons++;
     });
+    visible_points.round_power[vp] = power;
+    visible_points.round_photons[vp] = num_photons;
+}
+
+// shrink the radius and rescale the flux with the photons of the last round, see Hachisuka and Jensen, 2009
+void PhotonMappingRender::progressive_update(int vp) {
+    int round_photons = visible_points.round_photons[vp];
+    if (round_photons > 0) {
+        float num_photons = visible_points.num_photons[vp];
+        float new_num_photons = num_photons + alpha * (float) round_photons;
+        float radius_factor = new_num_photons / (num_photons + (float) round_photons);
+        Vector3f round_flux = visible_points.attenuation[vp] * visible_points.round_power[vp] / M_PI;
+        visible_points.photon_flux[vp] = (visible_points.photon_flux[vp] + round_flux) * radius_factor;
+        visible_points.radius[vp] *= std::sqrt(radius_factor);
+        visible_points.num_photons[vp] = new_num_photons;
+    }
+    visible_points.round_power[vp] = Vector3f::ZERO;
+    visible_points.round_photons[vp] = 0;
 }
 
 } // namespace RT
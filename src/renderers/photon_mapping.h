@@ -4,66 +4,140 @@
 #include <memory>
 #include <string>
 #include <vector>
-#include <mutex>
 
 #include <Vector3f.h>
 
 #include "core/hit.h"
 #include "core/light.h"
 #include "objects/object3d.h"
+#include "utils/alias_table.h"
 #include "utils/ball_finder.hpp"
+#include "utils/direction_guide.h"
+#include "utils/film.h"
+#include "utils/kd_tree.hpp"
+#include "utils/post_process.h"
 #include "utils/scene_parser.h"
 
+class ProgressBar;
+
 namespace RT {
 
 class Ray;
 class Camera;
 
-struct VisiblePoint {
-    VisiblePoint(): mtx(new std::mutex) {};
-    Vector3f center;
+// visible points of all pixels, in structure-of-arrays form and reused across rounds
+// the photon pass only touches the hot arrays
+struct VisiblePoints {
+    void Resize(int size, float init_radius);
+
+    // hot: read or written for each photon
+    std::vector<Vector3f> center;
+    std::vector<float> radius;               // progressive, carried across rounds
+    std::vector<Vector3f> round_power;       // sum of photon power in the current round
+    std::vector<int> round_photons;
 
     // determined in forward process
-    Vector3f forward_flux = Vector3f::ZERO;
-    Vector3f attenuation = Vector3f(1, 1, 1);
+    std::vector<Vector3f> forward_flux;
+    std::vector<Vector3f> attenuation;
+    std::vector<char> is_valid;              // the eye path ends on a diffuse surface, not vector<bool> which races
 
-    // determined in backward process
-    Vector3f photon_flux = Vector3f::ZERO;
-    int num_photons = 0;
-    float radius = -1;
+    // progressive statistics, carried across rounds
+    std::vector<Vector3f> photon_flux;
+    std::vector<float> num_photons;
+};
 
-    std::unique_ptr<std::mutex> mtx;
+// a photon landing on a diffuse surface
+struct Photon {
+    Vector3f pos;
+    Vector3f power;
+    Vector3f dir;  // incoming direction, not needed by lambert visible points
 };
 
 class PhotonMappingRender {
 public:
+    // backend "grid": visible points are put in a hash grid, each photon looks up the visible points around it
+    // backend "grid-batched": as "grid", but photons are traced in batches and deposited sorted by grid cell
+    // backend "kdtree": photons are stored in a kd-tree, each visible point gathers the photons around it
+    // guide_emission: isotropic lights learn to emit towards directions whose photons reach visible points
     PhotonMappingRender(float alpha, float init_radius, int num_rounds, int photons_per_round,
-                        int vp_per_pixel, const SceneParser &scene_parser);
+                        int vp_per_pixel, const std::string &backend, bool guide_emission,
+                        const SceneParser &scene_parser);
 
     void Render(const std::string &output_file);
 
+    // exposure, tone mapping and encoding of the output image, by default only the gamma of the scene
+    void SetPostProcess(const PostProcess &post);
+
+    // also save first-hit albedo, normal and depth, see Film::SaveAOVs()
+    void SetAOVs(bool with_aovs);
+
+    // filter the output with Denoiser guided by the AOVs
+    void SetDenoise(bool denoise);
+
+    // distribute the photon pass of each round over worker processes started with worker_command,
+    // which should render the same scene with the same options; files are exchanged in shard_dir
+    // the workers are started once and share the OpenMP threads of this process
+    void SetWorkers(int num_workers, const std::string &shard_dir, const std::vector<std::string> &worker_command);
+
+    // worker side: for every round, wait for its visible points, trace this worker's share of the photons,
+    // and write the photon statistics
+    void RunWorker(const std::string &shard_dir, int worker, int num_workers);
+
 private:
-    void trace_visible_point(VisiblePoint &vp, const Ray &ray, RNG &rng, int depth);
-    void trace_photon(const ColoredRay &ray, RNG &rng, int depth);
-    void update_nearby_vp(const Vector3f &pos, const Vector3f &attenuation);
+    enum class Backend {
+        Grid, BatchedGrid, KdTree
+    };
+    static constexpr int photon_batch_size = 1 << 18;
+
+    // feature: if not null, set to what the camera ray hits first
+    void trace_visible_point(int vp, const Ray &ray, RNG &rng, int depth, Film::Feature *feature = nullptr);
+    void start_workers();
+    void stop_workers();
+    void remove_exchange_files() const;
+    void run_workers(int round);
+    static std::string vp_file(const std::string &shard_dir, int round);
+    static std::string stats_file(const std::string &shard_dir, int round, int worker);
+
+    void trace_photons(int num_photons, ProgressBar &bar);
+    ColoredRay emit_photon(RNG &rng, int &light) const;
+    void trace_photon(const ColoredRay &ray, RNG &rng, int depth, std::vector<Photon> &photons);
+    void trace_photon_batch(int num_photons, ProgressBar &bar);
+    void deposit_photon_batch();
+    int update_nearby_vp(const Vector3f &pos, const Vector3f &attenuation);
+    void gather_photons(int vp);
+    void progressive_update(int vp);
 
     int width, height;
     const Object3D *obj;
     const Camera *camera;
     const Vector3f &bg_color;
     const std::vector<std::unique_ptr<Light>> &lights;
-    float gamma;
+    PostProcess post;
+    bool with_aovs = false;
+    bool denoise = false;
 
     float alpha;
     float init_radius;
     int num_rounds;
     int photons_per_round;
     int vp_per_pixel;
+    Backend backend;
 
     std::vector<Vector3f> img_data;
-    std::vector<VisiblePoint> visible_point_map;
-
-    BallFinder<VisiblePoint> ball_finder;
+    VisiblePoints visible_points;
+
+    AliasTable light_table;  // choose lights by power
+    std::vector<std::unique_ptr<DirectionGuide>> emission_guides;  // one for each light, nullptr if not guided
+
+    int num_workers = 0;
+    std::string shard_dir;
+    std::vector<std::string> worker_command;
+    std::vector<int> worker_pids;  // of the running workers
+    BallFinder ball_finder;
+    std::vector<Vector3f> photon_pos;    // photons of the current batch
+    std::vector<Vector3f> photon_power;
+    std::vector<Vector3f> photon_dir;
+    KdTree photon_tree;
 };
 
 } // namespace RT
@@ -2,6 +2,7 @@
 
 #include "renderers/photon_mapping.h"
 #include "utils/debug.h"
+#include "utils/post_process.h"
 #include "utils/scene_parser.h"
 
 int main(int argc, char *argv[]) {
@@ -12,12 +13,30 @@ int main(int argc, char *argv[]) {
     args::ValueFlag<std::string> input(parser, "input_file", "input file", {'i', "input"}, "scenes/tmp.yml");
     args::ValueFlag<std::string> output(parser, "output_file", "output file", {'o', "output"}, "output/output-sppm.bmp");
 
-    args::ValueFlag<int> vp_per_pixel(parser, "vp", "vp", {'v', "vp"}, 1);
+    args::ValueFlag<int> vp_per_pixel(parser, "vp", "visible points per pixel per round", {'v', "vp"}, 1);
     args::ValueFlag<int> photons_per_round(parser, "photons", "photons per round", {'p', "photons"}, 10000);
     args::ValueFlag<int> num_rounds(parser, "rounds", "rounds", {'n', "rounds"}, 5);
 
     args::ValueFlag<float> alpha(parser, "alpha", "ppm alpha", {'a', "alpha"}, 0.7);
     args::ValueFlag<float> init_radius(parser, "init-radius", "init radius", {'r', "radius"}, 0.001);
+    args::ValueFlag<std::string> backend(parser, "backend", "photon lookup: grid, grid-batched or kdtree", {"backend"}, "grid");
+    args::Flag guide(parser, "guide", "guide photon emission towards visible points", {"guide"});
+    args::ValueFlag<float> exposure(parser, "exposure", "exposure of the output in stops", {"exposure"}, 0);
+    args::ValueFlag<std::string> tonemap(parser, "tonemap", "tone mapping of 8-bit output: none, reinhard or aces",
+                                         {"tonemap"}, "none");
+    args::Flag aovs(parser, "aovs", "also save albedo, normal and depth as <output>_<name>.pfm", {"aovs"});
+    args::Flag denoise(parser, "denoise", "filter the output guided by albedo, normal and depth", {"denoise"});
+    args::Flag srgb(parser, "srgb", "encode 8-bit output with the sRGB curve instead of the scene gamma", {"srgb"});
+    args::ValueFlag<std::string> texture_cache(parser, "texture-cache", "map textures from tiled mip maps kept here",
+                                               {"texture-cache"}, "");
+    args::ValueFlag<int> texture_budget(parser, "texture-budget", "MB of mapped textures kept in memory",
+                                        {"texture-budget"}, 1024);
+
+    args::ValueFlag<int> num_workers(parser, "workers", "trace photons in this many worker processes", {"workers"}, 0);
+    args::ValueFlag<std::string> shard_dir(parser, "shard-dir", "directory of files exchanged with workers",
+                                           {"shard-dir"}, "output/sppm-shards");
+    // set by the coordinator when starting a worker
+    args::ValueFlag<int> worker(parser, "worker", "run as worker of this index", {"worker"}, -1);
 
     try {
         parser.ParseCLI(argc, argv);
@@ -29,6 +48,9 @@ int main(int argc, char *argv[]) {
     LOG(ERROR) << fmt::format("input: {}, output: {}", input.Get(), output.Get());
 
     RT::SceneParser scene_parser;
+    if (!texture_cache.Get().empty()) {
+        scene_parser.SetTextureCache(texture_cache.Get(), (size_t) texture_budget.Get() << 20);
+    }
     scene_parser.parse(args::get(input));
 
     RT::PhotonMappingRender renderer(
@@ -37,7 +59,19 @@ int main(int argc, char *argv[]) {
             num_rounds.Get(),
             photons_per_round.Get(),
             vp_per_pixel.Get(),
+            backend.Get(),
+            guide.Get(),
             scene_parser
     );
+    if (worker.Get() >= 0) {
+        renderer.RunWorker(shard_dir.Get(), worker.Get(), num_workers.Get());
+        return 0;
+    }
+    if (num_workers.Get() > 0) {
+        renderer.SetWorkers(num_workers.Get(), shard_dir.Get(), std::vector<std::string>(argv, argv + argc));
+    }
+    renderer.SetAOVs(aovs.Get());
+    renderer.SetDenoise(denoise.Get());
+    renderer.SetPostProcess(RT::PostProcess(scene_parser.gamma, exposure.Get(), tonemap.Get(), srgb.Get()));
     renderer.Render(output.Get());
 }
@@ -0,0 +1,81 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "./accumulation_buffer.h"
+#include "./debug.h"
+
+namespace RT {
+
+namespace {
+
+const char magic[8] = {'R', 'T', 'A', 'C', 'C', 'U', 'M', '2'};
+
+} // anonymous namespace
+
+AccumulationBuffer::AccumulationBuffer(int width, int height, float gamma) :
+        width(width), height(height), gamma(gamma), sum(width * height, Vector3f::ZERO), weight(width * height, 0.f),
+        count(width * height, 0) {}
+
+void AccumulationBuffer::AddSamples(int x, int y, const Vector3f &s, float w, int n) {
+    sum[y * width + x] += s;
+    weight[y * width + x] += w;
+    count[y * width + x] += n;
+}
+
+Vector3f AccumulationBuffer::Mean(int x, int y) const {
+    float w = weight[y * width + x];
+    return w > 0 ? sum[y * width + x] / w : Vector3f::ZERO;
+}
+
+void AccumulationBuffer::Merge(const AccumulationBuffer &other) {
+    if (other.width != width || other.height != height) {
+        throw std::runtime_error(fmt::format("cannot merge a {}x{} buffer into a {}x{} one",
+                                             other.width, other.height, width, height));
+    }
+    for (int i = 0; i < width * height; i++) {
+        sum[i] += other.sum[i];
+        weight[i] += other.weight[i];
+        count[i] += other.count[i];
+    }
+}
+
+// layout: magic, width, height, gamma, width * height sums of 3 floats, width * height weights, width * height counts
+void AccumulationBuffer::Save(const std::string &file_name) const {
+    std::ofstream file(file_name, std::ios::binary);
+    file.write(magic, sizeof(magic));
+    file.write(reinterpret_cast<const char *>(&width), sizeof(width));
+    file.write(reinterpret_cast<const char *>(&height), sizeof(height));
+    file.write(reinterpret_cast<const char *>(&gamma), sizeof(gamma));
+    static_assert(sizeof(Vector3f) == 3 * sizeof(float));
+    file.write(reinterpret_cast<const char *>(sum.data()), (std::streamsize) (sum.size() * sizeof(Vector3f)));
+    file.write(reinterpret_cast<const char *>(weight.data()), (std::streamsize) (weight.size() * sizeof(float)));
+    file.write(reinterpret_cast<const char *>(count.data()), (std::streamsize) (count.size() * sizeof(int)));
+    if (!file) {
+        throw std::runtime_error(fmt::format("failed to write '{}'", file_name));
+    }
+}
+
+AccumulationBuffer AccumulationBuffer::Load(const std::string &file_name) {
+    std::ifstream file(file_name, std::ios::binary);
+    char file_magic[sizeof(magic)] = {};
+    int width = 0, height = 0;
+    float gamma = 1;
+    file.read(file_magic, sizeof(file_magic));
+    file.read(reinterpret_cast<char *>(&width), sizeof(width));
+    file.read(reinterpret_cast<char *>(&height), sizeof(height));
+    file.read(reinterpret_cast<char *>(&gamma), sizeof(gamma));
+    if (!file || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || width <= 0 || height <= 0) {
+        throw std::runtime_error(fmt::format("'{}' is not an accumulation buffer", file_name));
+    }
+    AccumulationBuffer buffer(width, height, gamma);
+    file.read(reinterpret_cast<char *>(buffer.sum.data()), (std::streamsize) (buffer.sum.size() * sizeof(Vector3f)));
+    file.read(reinterpret_cast<char *>(buffer.weight.data()), (std::streamsize) (buffer.weight.size() * sizeof(float)));
+    file.read(reinterpret_cast<char *>(buffer.count.data()), (std::streamsize) (buffer.count.size() * sizeof(int)));
+    if (!file) {
+        throw std::runtime_error(fmt::format("'{}' is truncated", file_name));
+    }
+    return buffer;
+}
+
+} // namespace RT
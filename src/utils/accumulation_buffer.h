@@ -0,0 +1,45 @@
+#ifndef RT_ACCUMULATION_BUFFER_H
+#define RT_ACCUMULATION_BUFFER_H
+
+#include <string>
+#include <vector>
+
+#include <Vector3f.h>
+
+namespace RT {
+
+// Per-pixel filter weighted sum of linear radiance samples, the sum of the weights and the number of samples
+// Partial renders (shards) are saved in this form, so that they can be merged with correct weighting
+class AccumulationBuffer {
+public:
+    AccumulationBuffer(int width, int height, float gamma);
+
+    // each pixel should be written by one thread at a time
+    // sum: of the samples times their filter weights, which add up to weight
+    void AddSamples(int x, int y, const Vector3f &sum, float weight, int count);
+
+    // weighted average of the samples, black if there is no positive weight
+    [[nodiscard]] Vector3f Mean(int x, int y) const;
+    [[nodiscard]] int Count(int x, int y) const { return count[y * width + x]; }
+
+    // add up the samples of another buffer of the same size
+    void Merge(const AccumulationBuffer &other);
+
+    [[nodiscard]] int Width() const { return width; }
+    [[nodiscard]] int Height() const { return height; }
+    [[nodiscard]] float Gamma() const { return gamma; }
+
+    void Save(const std::string &file_name) const;
+    static AccumulationBuffer Load(const std::string &file_name);
+
+private:
+    int width, height;
+    float gamma;  // of the final image, kept so that merging needs no scene file
+    std::vector<Vector3f> sum;
+    std::vector<float> weight;
+    std::vector<int> count;
+};
+
+} // namespace RT
+
+#endif //RT_ACCUMULATION_BUFFER_H
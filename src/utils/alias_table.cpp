@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "./alias_table.h"
+#include "./debug.h"
+
+namespace RT {
+
+AliasTable::AliasTable(const std::vector<float> &weights) {
+    int n = (int) weights.size();
+    bins.resize(n);
+    double sum = 0;
+    for (float w: weights) {
+        CHECK(w >= 0) << "negative weight in alias table";
+        sum += w;
+    }
+    for (int i = 0; i < n; i++) {
+        bins[i].pmf = sum > 0 ? (float) (weights[i] / sum) : 1.f / (float) n;
+    }
+
+    // partition the scaled probabilities into under-full and over-full bins
+    std::vector<int> small, large;
+    std::vector<double> scaled(n);
+    for (int i = 0; i < n; i++) {
+        scaled[i] = (double) bins[i].pmf * n;
+        (scaled[i] < 1 ? small : large).emplace_back(i);
+    }
+
+    // fill every under-full bin with an over-full one
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        large.pop_back();
+        bins[s].q = (float) scaled[s];
+        bins[s].alias = l;
+        scaled[l] -= 1 - scaled[s];
+        (scaled[l] < 1 ? small : large).emplace_back(l);
+    }
+
+    // the remaining bins are full up to rounding error
+    for (int i: small) {
+        bins[i].q = 1;
+        bins[i].alias = i;
+    }
+    for (int i: large) {
+        bins[i].q = 1;
+        bins[i].alias = i;
+    }
+}
+
+int AliasTable::Sample(float u) const {
+    int n = (int) bins.size();
+    float un = u * (float) n;
+    int i = std::min((int) un, n - 1);
+    float up = std::min(un - (float) i, 1.f);
+    return up < bins[i].q ? i : bins[i].alias;
+}
+
+float AliasTable::Pmf(int i) const {
+    return bins[i].pmf;
+}
+
+} // namespace RT
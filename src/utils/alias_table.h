@@ -0,0 +1,32 @@
+#ifndef RT_ALIAS_TABLE_H
+#define RT_ALIAS_TABLE_H
+
+#include <vector>
+
+namespace RT {
+
+// Vose's alias method: sample from a discrete distribution in O(1)
+class AliasTable {
+public:
+    AliasTable() = default;
+
+    // weights need not be normalized, all zero weights give a uniform distribution
+    explicit AliasTable(const std::vector<float> &weights);
+
+    // sample an index with u uniformly distributed in [0, 1)
+    [[nodiscard]] int Sample(float u) const;
+    [[nodiscard]] float Pmf(int i) const;
+    [[nodiscard]] int Size() const { return (int) bins.size(); }
+
+private:
+    struct Bin {
+        float q;    // probability of keeping this index rather than its alias
+        float pmf;
+        int alias;
+    };
+    std::vector<Bin> bins;
+};
+
+} // namespace RT
+
+#endif //RT_ALIAS_TABLE_H
@@ -1,11 +1,11 @@
 #ifndef RT_BALL_FINDER_HPP
 #define RT_BALL_FINDER_HPP
 
-#include <map>
 #include <vector>
-#include <tuple>
-#include <functional>
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <cstdint>
 
 #include <Vector3f.h>
 
@@ -13,52 +13,156 @@ namespace RT {
 
 // This data structure stores a Set of balls in space
 // For a point, it can find all balls containing the point quickly
-// T should have `radius` and `center` members thus behaves like a ball
-template<typename T>
+// Balls are given in structure-of-arrays form: ball i has center centers[i] and radius radii[i]
+//
+// Balls are binned into grid cells, and cells are hashed into a fixed number of buckets.
+// The buckets are laid out contiguously (CSR style) together with a copy of the centers,
+// so a query touches at most 8 small arrays and no tree nodes. Different cells may share
+// a bucket, which is harmless because each ball is tested against the query point anyway.
 class BallFinder {
 public:
     explicit BallFinder(float grid_size): grid_size(grid_size) {};
 
-    void AddBall(T *t) {
-        assert(t->radius * 2 <= grid_size);
-        const Vector3f &p = t->center;
-        float x = p.x() / grid_size, y = p.y() / grid_size, z = p.z() / grid_size;
-        int xf = std::floor(x), yf = std::floor(y), zf = std::floor(z);
-        ball_grid[std::make_tuple(xf, yf, zf)].emplace_back(t);
-    };
+    // bucket the balls i in [0, count) for which include(i) holds, in parallel
+    // centers are copied, radii are read at query time and must outlive the queries
+    template<typename P>
+    void Build(const Vector3f *centers, const float *radii, int count, P &&include) {
+        this->radii = radii;
+        uint32_t table_size = 1;
+        while (table_size < (uint32_t) count) table_size <<= 1;
+        hash_mask = table_size - 1;
+
+        std::vector<uint32_t> ball_bucket(count);
+#pragma omp parallel for schedule(static) default(none) shared(count, centers, radii, include, ball_bucket)
+        for (int i = 0; i < count; i++) {
+            if (!include(i)) {
+                ball_bucket[i] = no_bucket;
+                continue;
+            }
+            assert(radii[i] * 2 <= grid_size);
+            const Vector3f &p = centers[i];
+            ball_bucket[i] = bucket(std::floor(p.x() / grid_size), std::floor(p.y() / grid_size), std::floor(p.z() / grid_size));
+        }
+        counting_sort(ball_bucket, table_size, bucket_start, ball_index);
+
+        const int num_balls = (int) ball_index.size();
+        ball_centers.resize(num_balls);
+#pragma omp parallel for schedule(static) default(none) shared(centers, num_balls)
+        for (int i = 0; i < num_balls; i++) {
+            ball_centers[i] = centers[ball_index[i]];
+        }
+    }
 
-    // for each ball containing p, invoke f(center, radius)
-    // and update the radius of the ball to the return value of f
+    void Build(const Vector3f *centers, const float *radii, int count) {
+        Build(centers, radii, count, [](int) { return true; });
+    }
+
+    // for each ball containing p, invoke f(index of the ball)
+    // f may update the radius of the ball
     // IMPORTANT: the caller should only reduce the radius of stored balls, DO NOT ENLARGE
-    void FindAndOperateBalls(const Vector3f &p, const std::function<void(T*)> &f) const {
+    template<typename F>
+    void FindAndOperateBalls(const Vector3f &p, F &&f) const {
+        if (ball_index.empty()) return;
         float x = p.x() / grid_size, y = p.y() / grid_size, z = p.z() / grid_size;
         float xf = std::round(x), yf = std::round(y), zf = std::round(z);
         int xi = (int) xf, yi = (int) yf, zi = (int) zf;
+
+        // neighbouring cells may collide into one bucket, visit each bucket once
+        uint32_t visited[8];
+        int num_visited = 0;
         for (int xii = xi - 1; xii <= xi; xii++) {
             for (int yii = yi - 1; yii <= yi; yii++) {
                 for (int zii = zi - 1; zii <= zi; zii++) {
-                    auto grid_idx = std::make_tuple(xii, yii, zii);
-                    if (ball_grid.count(grid_idx) > 0) {
-                        for (auto t: ball_grid.at(grid_idx)) {
-                            if ((t->center - p).length() <= t->radius) {
-                                f(t);
-                            } // if dist
-                        } // for balls
-                    } // if grid not empty
+                    uint32_t b = bucket(xii, yii, zii);
+                    bool seen = false;
+                    for (int i = 0; i < num_visited; i++) {
+                        seen |= visited[i] == b;
+                    }
+                    if (seen) continue;
+                    visited[num_visited++] = b;
+
+                    for (uint32_t i = bucket_start[b]; i < bucket_start[b + 1]; i++) {
+                        int index = ball_index[i];
+                        if ((ball_centers[i] - p).squaredLength() <= radii[index] * radii[index]) {
+                            f(index);
+                        } // if dist
+                    } // for balls
                 } // for zii
             } // for yii
         } // for xii
     };
 
+    // a permutation of points[0, count) in which points querying the same cells are adjacent
+    // batched queries in this order hit the same balls in a row, see PhotonMappingRender
+    // the points of bucket b are [start[b], start[b + 1]) of the permutation
+    std::vector<int> QueryOrder(const Vector3f *points, int count, std::vector<uint32_t> &start) const {
+        std::vector<uint32_t> point_bucket(count);
+#pragma omp parallel for schedule(static) default(none) shared(points, count, point_bucket)
+        for (int i = 0; i < count; i++) {
+            const Vector3f &p = points[i];
+            point_bucket[i] = bucket(std::round(p.x() / grid_size), std::round(p.y() / grid_size), std::round(p.z() / grid_size));
+        }
+        std::vector<int> order;
+        counting_sort(point_bucket, hash_mask + 1, start, order);
+        return order;
+    }
+
     void Reset() {
-        ball_grid.clear();
+        ball_index.clear();
+        ball_centers.clear();
+        bucket_start.clear();
+        radii = nullptr;
     }
 
 private:
-    using grid_index_t = std::tuple<int, int, int>;
-    using ball_grid_t = std::map<grid_index_t, std::vector<T*>>;
+    static constexpr uint32_t no_bucket = UINT32_MAX;
+
+    // parallel counting sort of the indices of keys, skipping no_bucket
+    // indices of key b end up in order[start[b], start[b + 1]), sorted, so the result does not depend on threads
+    static void counting_sort(const std::vector<uint32_t> &keys, uint32_t num_buckets,
+                              std::vector<uint32_t> &start, std::vector<int> &order) {
+        // 1. size of each bucket
+        const int count = (int) keys.size();
+        start.assign(num_buckets + 1, 0);
+#pragma omp parallel for schedule(static) default(none) shared(keys, count, start)
+        for (int i = 0; i < count; i++) {
+            if (keys[i] == no_bucket) continue;
+#pragma omp atomic
+            start[keys[i] + 1]++;
+        }
+
+        // 2. prefix sum
+        for (uint32_t b = 0; b < num_buckets; b++) {
+            start[b + 1] += start[b];
+        }
+
+        // 3. scatter, then restore the input order inside each bucket
+        std::vector<uint32_t> end(start.begin(), start.end() - 1);
+        order.resize(start[num_buckets]);
+#pragma omp parallel for schedule(static) default(none) shared(keys, count, end, order)
+        for (int i = 0; i < count; i++) {
+            uint32_t b = keys[i];
+            if (b == no_bucket) continue;
+            uint32_t slot;
+#pragma omp atomic capture
+            slot = end[b]++;
+            order[slot] = i;
+        }
+#pragma omp parallel for schedule(dynamic, 1024) default(none) shared(num_buckets, start, order)
+        for (uint32_t b = 0; b < num_buckets; b++) {
+            std::sort(order.begin() + start[b], order.begin() + start[b + 1]);
+        }
+    }
+
+    [[nodiscard]] uint32_t bucket(int x, int y, int z) const {
+        return (((uint32_t) x * 73856093u) ^ ((uint32_t) y * 19349663u) ^ ((uint32_t) z * 83492791u)) & hash_mask;
+    }
 
-    ball_grid_t ball_grid;
+    std::vector<int> ball_index;         // sorted by bucket
+    std::vector<Vector3f> ball_centers;  // ball_centers[i] is the center of ball ball_index[i]
+    std::vector<uint32_t> bucket_start;  // balls of bucket b are [bucket_start[b], bucket_start[b + 1])
+    const float *radii = nullptr;
+    uint32_t hash_mask = 0;
     float grid_size;
 };
 
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "./denoiser.h"
+#include "./debug.h"
+#include "./film.h"
+#include "./image.h"
+#include "./math_util.h"
+
+namespace RT {
+
+namespace {
+
+// B3 spline kernel, indexed by the absolute offset
+constexpr float kernel[3] = {3.f / 8, 1.f / 4, 1.f / 16};
+constexpr int tile_size = 32;
+
+constexpr float sigma_luminance = 4;   // in standard deviations of the pixel mean
+constexpr float sigma_normal = 64;     // exponent of the normal cosine
+constexpr float sigma_depth = 0.05;    // relative depth change per pixel of distance
+constexpr float sigma_albedo = 0.1;
+constexpr float min_albedo = 0.01;     // darker albedo is not divided out
+
+struct Guide {
+    std::vector<Vector3f> albedo, normal;
+    std::vector<float> depth;
+};
+
+float edge_weight(const Guide &guide, int p, int q, float luminance_p, float luminance_q, float std_dev, float dist) {
+    const Vector3f &np = guide.normal[p], &nq = guide.normal[q];
+    float w_normal;
+    if (np == Vector3f::ZERO || nq == Vector3f::ZERO) {
+        // background only mixes with background
+        w_normal = np == nq ? 1.f : 0.f;
+    } else {
+        w_normal = std::pow(std::max(0.f, Vector3f::dot(np, nq)), sigma_normal);
+    }
+    const float dz = std::abs(guide.depth[p] - guide.depth[q]);
+    const float w_depth = std::exp(-dz / (sigma_depth * guide.depth[p] * dist + 1e-4f));
+    const float w_albedo = std::exp(-(guide.albedo[p] - guide.albedo[q]).squaredLength() / fsquare(sigma_albedo));
+    const float w_luminance = std::exp(-std::abs(luminance_p - luminance_q) / (sigma_luminance * std_dev + 1e-4f));
+    return w_normal * w_depth * w_albedo * w_luminance;
+}
+
+} // anonymous namespace
+
+Denoiser::Denoiser(int iterations) : iterations(iterations) {}
+
+void Denoiser::Denoise(const Film &film, Image &img) const {
+    CHECK(film.HasAOVs()) << "denoising needs the AOVs of the film";
+    const int width = film.Width(), height = film.Height(), n = width * height;
+
+    Guide guide{std::vector<Vector3f>(n), std::vector<Vector3f>(n), std::vector<float>(n)};
+    std::vector<Vector3f> modulation(n), color(n), next_color(n);
+    std::vector<float> variance(n), next_variance(n);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const int i = y * width + x;
+            guide.albedo[i] = film.Albedo(x, y);
+            guide.normal[i] = film.Normal(x, y);
+            guide.depth[i] = film.Depth(x, y);
+            for (int c = 0; c < 3; c++) {
+                if (!is_finite(guide.albedo[i][c]) || !is_finite(guide.normal[i][c])) {
+                    guide.albedo[i] = guide.normal[i] = Vector3f::ZERO;
+                }
+            }
+            if (!is_finite(guide.depth[i])) guide.depth[i] = 0;
+            for (int c = 0; c < 3; c++) {
+                modulation[i][c] = guide.albedo[i][c] > min_albedo ? guide.albedo[i][c] : 1.f;
+            }
+            color[i] = film.Radiance(x, y) / modulation[i];
+            for (int c = 0; c < 3; c++) {
+                // a single NaN or infinite pixel would spread over the whole footprint
+                if (!is_finite(color[i][c])) color[i][c] = 0;
+            }
+            // variance of the pixel mean, negative if unknown
+            const int count = film.Count(x, y);
+            variance[i] = count >= 2 ? film.Variance(x, y) / (float) count / fsquare(luminance(modulation[i])) : -1.f;
+            if (!is_finite(variance[i])) variance[i] = -1.f;
+        }
+    }
+
+    // renderers without per-pixel statistics (e.g. SPPM) get the spatial variance of the 3x3 neighborhood
+#pragma omp parallel for schedule(static) default(none) shared(width, height, color, variance)
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (variance[y * width + x] >= 0) continue;
+            float sum = 0, sum_sq = 0;
+            int count = 0;
+            for (int qy = std::max(y - 1, 0); qy <= std::min(y + 1, height - 1); qy++) {
+                for (int qx = std::max(x - 1, 0); qx <= std::min(x + 1, width - 1); qx++) {
+                    float l = luminance(color[qy * width + qx]);
+                    sum += l;
+                    sum_sq += l * l;
+                    count++;
+                }
+            }
+            variance[y * width + x] = std::max(0.f, sum_sq / (float) count - fsquare(sum / (float) count));
+        }
+    }
+
+    const int tiles_x = (width + tile_size - 1) / tile_size, tiles_y = (height + tile_size - 1) / tile_size;
+    for (int it = 0; it < iterations; it++) {
+        const int step = 1 << it;
+#pragma omp parallel for collapse(2) schedule(dynamic) default(none) \
+        shared(kernel, tiles_x, tiles_y, width, height, step, guide, color, variance, next_color, next_variance)
+        for (int ty = 0; ty < tiles_y; ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                for (int y = ty * tile_size; y < std::min((ty + 1) * tile_size, height); y++) {
+                    for (int x = tx * tile_size; x < std::min((tx + 1) * tile_size, width); x++) {
+                        const int p = y * width + x;
+                        const float luminance_p = luminance(color[p]);
+                        const float std_dev = std::sqrt(variance[p]);
+                        Vector3f sum_color = Vector3f::ZERO;
+                        float sum_variance = 0, sum_weight = 0;
+                        for (int dy = -2; dy <= 2; dy++) {
+                            const int qy = y + dy * step;
+                            if (qy < 0 || qy >= height) continue;
+                            for (int dx = -2; dx <= 2; dx++) {
+                                const int qx = x + dx * step;
+                                if (qx < 0 || qx >= width) continue;
+                                const int q = qy * width + qx;
+                                float w = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                                if (q != p) {
+                                    const float dist = (float) step * std::sqrt((float) (dx * dx + dy * dy));
+                                    w *= edge_weight(guide, p, q, luminance_p, luminance(color[q]), std_dev, dist);
+                                }
+                                sum_color += w * color[q];
+                                sum_variance += w * w * variance[q];
+                                sum_weight += w;
+                            }
+                        }
+                        // the center always has a positive weight
+                        next_color[p] = sum_color / sum_weight;
+                        next_variance[p] = sum_variance / fsquare(sum_weight);
+                    }
+                }
+            }
+        }
+        std::swap(color, next_color);
+        std::swap(variance, next_variance);
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            img.SetPixel(x, y, color[y * width + x] * modulation[y * width + x]);
+        }
+    }
+}
+
+} // namespace RT
@@ -0,0 +1,26 @@
+#ifndef RT_DENOISER_H
+#define RT_DENOISER_H
+
+namespace RT {
+
+class Film;
+class Image;
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance guided luminance weight of SVGF
+// Radiance is divided by the first-hit albedo before filtering and multiplied back afterwards, so textures stay sharp,
+// while normal, depth and albedo differences stop the filter at geometric and material edges
+class Denoiser {
+public:
+    // each iteration doubles the footprint of the 5x5 kernel, 5 iterations cover about 125x125 pixels
+    explicit Denoiser(int iterations = 5);
+
+    // write the filtered radiance of film to img of the same size, the film needs AOVs
+    void Denoise(const Film &film, Image &img) const;
+
+private:
+    int iterations;
+};
+
+} // namespace RT
+
+#endif //RT_DENOISER_H
@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <cmath>
+
+#include "./direction_guide.h"
+#include "./math_util.h"
+
+namespace RT {
+
+DirectionGuide::DirectionGuide(int num_phi, int num_theta) :
+        num_phi(num_phi), num_theta(num_theta), histogram(num_phi * num_theta, 0.f) {}
+
+void DirectionGuide::Record(const Vector3f &dir, float weight) {
+    Vector2f p = to_square(dir);
+    int u = std::min((int) (p.x() * (float) num_phi), num_phi - 1);
+    int v = std::min((int) (p.y() * (float) num_theta), num_theta - 1);
+#pragma omp atomic
+    histogram[v * num_phi + u] += weight;
+}
+
+void DirectionGuide::Update() {
+    is_trained = std::any_of(histogram.begin(), histogram.end(), [](float h) { return h > 0; });
+    if (is_trained) {
+        distribution = PiecewiseConstant2D(histogram, num_phi, num_theta);
+    }
+}
+
+Vector3f DirectionGuide::Sample(RNG &rng, float &pdf) const {
+    Vector3f dir;
+    if (!is_trained || rng.RandUniformFloat() < uniform_fraction) {
+        dir = rng.RandNormalizedVector();
+    } else {
+        float square_pdf;
+        dir = from_square(distribution.Sample(rng.RandUniformFloat(), rng.RandUniformFloat(), square_pdf));
+    }
+    pdf = Pdf(dir);
+    return dir;
+}
+
+float DirectionGuide::Pdf(const Vector3f &dir) const {
+    const float uniform_pdf = 1 / (4 * (float) M_PI);
+    if (!is_trained) return uniform_pdf;
+    // the map to the unit square has a constant jacobian of 4 pi
+    float guided_pdf = distribution.Pdf(to_square(dir)) * uniform_pdf;
+    return uniform_fraction * uniform_pdf + (1 - uniform_fraction) * guided_pdf;
+}
+
+Vector2f DirectionGuide::to_square(const Vector3f &dir) {
+    Vector3f d = dir.normalized();
+    float phi = std::atan2(d.y(), d.x());
+    if (phi < 0) phi += 2 * (float) M_PI;
+    return {clamp1(phi / (2 * (float) M_PI)), clamp1((1 - d.z()) / 2)};
+}
+
+Vector3f DirectionGuide::from_square(const Vector2f &p) {
+    float z = 1 - 2 * p.y();
+    float r = std::sqrt(std::max(0.f, 1 - z * z));
+    float phi = 2 * (float) M_PI * p.x();
+    return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+} // namespace RT
@@ -0,0 +1,47 @@
+#ifndef RT_DIRECTION_GUIDE_H
+#define RT_DIRECTION_GUIDE_H
+
+#include <vector>
+
+#include <Vector2f.h>
+#include <Vector3f.h>
+
+#include "utils/distribution.h"
+
+namespace RT {
+
+class RNG;
+
+// A learned distribution of directions on the unit sphere
+// Directions are binned with the equal-area map (phi, cos theta), so every bin covers the same solid angle.
+// Samples are drawn from a mixture of the uniform distribution and the recorded histogram;
+// the uniform part keeps the density positive everywhere, thus estimators stay unbiased
+class DirectionGuide {
+public:
+    explicit DirectionGuide(int num_phi = 32, int num_theta = 16);
+
+    // record that a sample in dir turned out useful, thread-safe
+    void Record(const Vector3f &dir, float weight);
+
+    // rebuild the sampling distribution from everything recorded so far
+    void Update();
+
+    // density w.r.t. solid angle
+    Vector3f Sample(RNG &rng, float &pdf) const;
+    [[nodiscard]] float Pdf(const Vector3f &dir) const;
+
+private:
+    [[nodiscard]] static Vector2f to_square(const Vector3f &dir);
+    [[nodiscard]] static Vector3f from_square(const Vector2f &p);
+
+    static constexpr float uniform_fraction = 0.5f;
+
+    int num_phi, num_theta;
+    std::vector<float> histogram;
+    PiecewiseConstant2D distribution;
+    bool is_trained = false;
+};
+
+} // namespace RT
+
+#endif //RT_DIRECTION_GUIDE_H
@@ -0,0 +1,70 @@
+#include <algorithm>
+
+#include "./distribution.h"
+#include "./debug.h"
+
+namespace RT {
+
+PiecewiseConstant1D::PiecewiseConstant1D(const std::vector<float> &f) : func(f) {
+    int n = (int) func.size();
+    CHECK(n > 0) << "empty distribution";
+    cdf.resize(n + 1);
+    cdf[0] = 0;
+    for (int i = 0; i < n; i++) {
+        CHECK(func[i] >= 0) << "negative value in distribution";
+        cdf[i + 1] = cdf[i] + func[i] / (float) n;
+    }
+    func_int = cdf[n];
+    for (int i = 1; i <= n; i++) {
+        cdf[i] = func_int > 0 ? cdf[i] / func_int : (float) i / (float) n;
+    }
+}
+
+float PiecewiseConstant1D::Sample(float u, float &pdf, int *offset) const {
+    int n = (int) func.size();
+    // the last cdf entry not greater than u
+    int o = (int) (std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+    o = std::clamp(o, 0, n - 1);
+    if (offset != nullptr) *offset = o;
+
+    float du = u - cdf[o];
+    if (cdf[o + 1] - cdf[o] > 0) du /= cdf[o + 1] - cdf[o];
+    pdf = func_int > 0 ? func[o] / func_int : 1.f;
+    return std::min(((float) o + du) / (float) n, 0.99999994f);
+}
+
+float PiecewiseConstant1D::Pdf(float x) const {
+    int n = (int) func.size();
+    int o = std::clamp((int) (x * (float) n), 0, n - 1);
+    return func_int > 0 ? func[o] / func_int : 1.f;
+}
+
+PiecewiseConstant2D::PiecewiseConstant2D(const std::vector<float> &func, int nu, int nv) {
+    CHECK(func.size() == (size_t) nu * nv) << "size of 2d distribution mismatch";
+    conditional.reserve(nv);
+    std::vector<float> marginal_func;
+    marginal_func.reserve(nv);
+    for (int v = 0; v < nv; v++) {
+        const PiecewiseConstant1D &row = conditional.emplace_back(
+                std::vector<float>(func.begin() + v * nu, func.begin() + (v + 1) * nu));
+        marginal_func.emplace_back(row.Integral());
+    }
+    marginal = PiecewiseConstant1D(marginal_func);
+}
+
+Vector2f PiecewiseConstant2D::Sample(float u0, float u1, float &pdf) const {
+    float pdf_v, pdf_u;
+    int v;
+    float y = marginal.Sample(u1, pdf_v, &v);
+    float x = conditional[v].Sample(u0, pdf_u);
+    pdf = pdf_v * pdf_u;
+    return {x, y};
+}
+
+float PiecewiseConstant2D::Pdf(const Vector2f &p) const {
+    int nv = (int) conditional.size();
+    int v = std::clamp((int) (p.y() * (float) nv), 0, nv - 1);
+    return marginal.Pdf(p.y()) * conditional[v].Pdf(p.x());
+}
+
+} // namespace RT
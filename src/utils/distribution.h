@@ -0,0 +1,50 @@
+#ifndef RT_DISTRIBUTION_H
+#define RT_DISTRIBUTION_H
+
+#include <vector>
+
+#include <Vector2f.h>
+
+namespace RT {
+
+// piecewise constant function on [0, 1], sampled by inverting its CDF
+class PiecewiseConstant1D {
+public:
+    PiecewiseConstant1D() = default;
+
+    // func should be non-negative, an all-zero function is sampled uniformly
+    explicit PiecewiseConstant1D(const std::vector<float> &func);
+
+    // map u uniformly distributed in [0, 1) to [0, 1) with density proportional to func
+    float Sample(float u, float &pdf, int *offset = nullptr) const;
+
+    [[nodiscard]] float Pdf(float x) const;
+    [[nodiscard]] float Integral() const { return func_int; }
+    [[nodiscard]] int Size() const { return (int) func.size(); }
+
+private:
+    std::vector<float> func;
+    std::vector<float> cdf;  // size() + 1 entries
+    float func_int = 0;
+};
+
+// piecewise constant function on [0, 1]^2, e.g. for importance sampling a texture
+class PiecewiseConstant2D {
+public:
+    PiecewiseConstant2D() = default;
+
+    // func[v * nu + u] is the value of the cell at column u, row v
+    PiecewiseConstant2D(const std::vector<float> &func, int nu, int nv);
+
+    Vector2f Sample(float u0, float u1, float &pdf) const;
+
+    [[nodiscard]] float Pdf(const Vector2f &p) const;
+
+private:
+    std::vector<PiecewiseConstant1D> conditional;  // one for each row
+    PiecewiseConstant1D marginal;
+};
+
+} // namespace RT
+
+#endif //RT_DISTRIBUTION_H
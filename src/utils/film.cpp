@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+
+#include "./film.h"
+#include "./image.h"
+#include "./math_util.h"
+
+namespace RT {
+
+void Film::Pixel::AddRadiance(const Vector3f &r) {
+    radiance += r;
+    weight += 1;
+    AddSplattedRadiance(r);
+}
+
+void Film::Pixel::AddSplattedRadiance(const Vector3f &r) {
+    const float l = RT::luminance(r);
+    luminance += l;
+    luminance_sq += l * l;
+    count++;
+}
+
+void Film::Pixel::AddFeature(const Feature &f) {
+    feature.albedo += f.albedo;
+    feature.normal += f.normal;
+    feature.depth += f.depth;
+    feature_count++;
+}
+
+Film::Film(int width, int height, bool with_aovs) :
+        width(width), height(height), with_aovs(with_aovs),
+        radiance(3 * width * height, 0.f), weight(width * height, 0.f), luminance(width * height, 0.f),
+        luminance_sq(width * height, 0.f), count(width * height, 0) {
+    if (with_aovs) {
+        albedo.resize(3 * width * height, 0.f);
+        normal.resize(3 * width * height, 0.f);
+        depth.resize(width * height, 0.f);
+        feature_count.resize(width * height, 0);
+    }
+}
+
+void Film::AddPixel(int x, int y, const Pixel &pixel) {
+    const int i = y * width + x;
+    if (pixel.weight != 0) {
+        for (int c = 0; c < 3; c++) {
+#pragma omp atomic
+            radiance[3 * i + c] += pixel.radiance[c];
+        }
+#pragma omp atomic
+        weight[i] += pixel.weight;
+    }
+#pragma omp atomic
+    luminance[i] += pixel.luminance;
+#pragma omp atomic
+    luminance_sq[i] += pixel.luminance_sq;
+#pragma omp atomic
+    count[i] += pixel.count;
+    if (!with_aovs || pixel.feature_count == 0) {
+        return;
+    }
+    for (int c = 0; c < 3; c++) {
+#pragma omp atomic
+        albedo[3 * i + c] += pixel.feature.albedo[c];
+#pragma omp atomic
+        normal[3 * i + c] += pixel.feature.normal[c];
+    }
+#pragma omp atomic
+    depth[i] += pixel.feature.depth;
+#pragma omp atomic
+    feature_count[i] += pixel.feature_count;
+}
+
+Vector3f Film::Radiance(int x, int y) const {
+    const int i = y * width + x;
+    // negative lobes of a filter could leave a pixel without positive weight
+    if (weight[i] <= 0) return Vector3f::ZERO;
+    return Vector3f(radiance[3 * i], radiance[3 * i + 1], radiance[3 * i + 2]) / weight[i];
+}
+
+Vector3f Film::WeightedRadiance(int x, int y) const {
+    const int i = y * width + x;
+    return Vector3f(radiance[3 * i], radiance[3 * i + 1], radiance[3 * i + 2]);
+}
+
+float Film::Variance(int x, int y) const {
+    const int i = y * width + x, n = count[i];
+    if (n < 2) return 0;
+    const float mean = luminance[i] / (float) n;
+    return std::max(0.f, (luminance_sq[i] - (float) n * mean * mean) / (float) (n - 1));
+}
+
+Film::Tile::Tile(int x0, int y0, int x1, int y1, const Filter &filter) : filter(filter) {
+    const int margin = (int) std::ceil(filter.Radius());
+    this->x0 = x0 - margin;
+    this->y0 = y0 - margin;
+    width = x1 - x0 + 2 * margin;
+    height = y1 - y0 + 2 * margin;
+    radiance.assign(width * height, Vector3f::ZERO);
+    weight.assign(width * height, 0.f);
+}
+
+void Film::Tile::Splat(float px, float py, const Vector3f &r) {
+    // pixel (x, y) has its center at (x + 0.5, y + 0.5)
+    const float radius = filter.Radius();
+    const int first_x = std::max(x0, (int) std::ceil(px - 0.5f - radius));
+    const int last_x = std::min(x0 + width - 1, (int) std::floor(px - 0.5f + radius));
+    const int first_y = std::max(y0, (int) std::ceil(py - 0.5f - radius));
+    const int last_y = std::min(y0 + height - 1, (int) std::floor(py - 0.5f + radius));
+    for (int y = first_y; y <= last_y; y++) {
+        const float wy = filter.Evaluate((float) y + 0.5f - py);
+        if (wy == 0) continue;
+        for (int x = first_x; x <= last_x; x++) {
+            const float w = wy * filter.Evaluate((float) x + 0.5f - px);
+            if (w == 0) continue;
+            const int i = (y - y0) * width + (x - x0);
+            radiance[i] += w * r;
+            weight[i] += w;
+        }
+    }
+}
+
+void Film::AddTile(const Tile &tile) {
+    for (int ty = 0; ty < tile.height; ty++) {
+        const int y = tile.y0 + ty;
+        if (y < 0 || y >= height) continue;
+        for (int tx = 0; tx < tile.width; tx++) {
+            const int x = tile.x0 + tx, t = ty * tile.width + tx;
+            if (x < 0 || x >= width || tile.weight[t] == 0) continue;
+            // only the margin overlaps other tiles, but the interior is cheap to add atomically too
+            const int i = y * width + x;
+            for (int c = 0; c < 3; c++) {
+#pragma omp atomic
+                radiance[3 * i + c] += tile.radiance[t][c];
+            }
+#pragma omp atomic
+            weight[i] += tile.weight[t];
+        }
+    }
+}
+
+Vector3f Film::Albedo(int x, int y) const {
+    const int i = y * width + x;
+    if (!with_aovs || feature_count[i] == 0) return Vector3f::ZERO;
+    return Vector3f(albedo[3 * i], albedo[3 * i + 1], albedo[3 * i + 2]) / (float) feature_count[i];
+}
+
+Vector3f Film::Normal(int x, int y) const {
+    const int i = y * width + x;
+    if (!with_aovs) return Vector3f::ZERO;
+    Vector3f n(normal[3 * i], normal[3 * i + 1], normal[3 * i + 2]);
+    float length = n.length();
+    return length > 0 ? n / length : Vector3f::ZERO;
+}
+
+float Film::Depth(int x, int y) const {
+    const int i = y * width + x;
+    if (!with_aovs || feature_count[i] == 0) return 0;
+    return depth[i] / (float) feature_count[i];
+}
+
+void Film::Develop(Image &img) const {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            img.SetPixel(x, y, Radiance(x, y));
+        }
+    }
+}
+
+void Film::Save(const std::string &file_name, const PostProcess &post) const {
+    Image img(width, height);
+    Develop(img);
+    img.SaveImage(file_name.c_str(), post);
+}
+
+void Film::SaveAOVs(const std::string &prefix, bool with_statistics) const {
+    Image img(width, height);
+    auto save = [&](const std::string &name, auto &&get) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                img.SetPixel(x, y, get(x, y));
+            }
+        }
+        img.SavePFM((prefix + "_" + name + ".pfm").c_str());
+    };
+    if (with_aovs) {
+        save("albedo", [this](int x, int y) { return Albedo(x, y); });
+        save("normal", [this](int x, int y) { return Normal(x, y); });
+        save("depth", [this](int x, int y) { return Vector3f(Depth(x, y)); });
+    }
+    if (with_statistics) {
+        save("variance", [this](int x, int y) { return Vector3f(Variance(x, y)); });
+        save("samples", [this](int x, int y) { return Vector3f((float) Count(x, y)); });
+    }
+}
+
+} // namespace RT
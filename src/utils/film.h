@@ -0,0 +1,108 @@
+#ifndef RT_FILM_H
+#define RT_FILM_H
+
+#include <string>
+#include <vector>
+
+#include <Vector3f.h>
+
+#include "./filter.h"
+#include "./post_process.h"
+
+namespace RT {
+
+class Image;
+
+// Framebuffer of a render: linear radiance with per-pixel sample count and variance, and optionally
+// auxiliary buffers (AOVs) of first-hit albedo, normal and depth, which guide denoising
+// Radiance is a weighted average, so that samples can be splatted to neighbouring pixels by a reconstruction filter
+class Film {
+public:
+    // what the camera ray of a sample hits first, all zero if it hits nothing
+    struct Feature {
+        Vector3f albedo, normal;
+        float depth = 0;
+    };
+
+    // samples of one pixel gathered by a single thread, then added to the film at once
+    struct Pixel {
+        Vector3f radiance;  // weighted sum
+        float weight = 0;
+        float luminance = 0, luminance_sq = 0;  // sums of the luminance and its square, for the variance
+        int count = 0;
+        Feature feature;  // sums of the features
+        int feature_count = 0;
+
+        // a sample of weight 1 for this pixel only
+        void AddRadiance(const Vector3f &r);
+        // a sample whose radiance is splatted with a Tile, only counted in the statistics of this pixel
+        void AddSplattedRadiance(const Vector3f &r);
+        void AddFeature(const Feature &f);
+    };
+
+    // filter weighted radiance of the samples in pixels [x0, x1) x [y0, y1), gathered by a single thread
+    // the buffer has a margin for the pixels of neighbouring tiles reached by the filter
+    class Tile {
+    public:
+        Tile(int x0, int y0, int x1, int y1, const Filter &filter);
+
+        // add a sample at continuous image position (px, py) to all pixels whose center is within the filter radius
+        void Splat(float px, float py, const Vector3f &radiance);
+
+    private:
+        friend class Film;
+
+        const Filter &filter;
+        int x0, y0, width, height;  // of the buffer, including the margin
+        std::vector<Vector3f> radiance;
+        std::vector<float> weight;
+    };
+
+    Film(int width, int height, bool with_aovs);
+
+    // thread-safe, a pixel may receive samples from several threads
+    void AddPixel(int x, int y, const Pixel &pixel);
+
+    // thread-safe, splats outside the film are dropped
+    void AddTile(const Tile &tile);
+
+    // averages, zero if there is no sample
+    [[nodiscard]] Vector3f Radiance(int x, int y) const;
+    [[nodiscard]] int Count(int x, int y) const { return count[y * width + x]; }
+    // filter weighted sum of the radiance, and the sum of the weights it is divided by
+    [[nodiscard]] Vector3f WeightedRadiance(int x, int y) const;
+    [[nodiscard]] float Weight(int x, int y) const { return weight[y * width + x]; }
+    // unbiased sample variance of the luminance, zero with less than 2 samples
+    [[nodiscard]] float Variance(int x, int y) const;
+    [[nodiscard]] Vector3f Albedo(int x, int y) const;
+    // normalized average normal
+    [[nodiscard]] Vector3f Normal(int x, int y) const;
+    [[nodiscard]] float Depth(int x, int y) const;
+
+    [[nodiscard]] int Width() const { return width; }
+    [[nodiscard]] int Height() const { return height; }
+    [[nodiscard]] bool HasAOVs() const { return with_aovs; }
+
+    // copy the average radiance to img, of the same size
+    void Develop(Image &img) const;
+
+    // save the radiance with post processing, format by extension, see Image::SaveImage()
+    void Save(const std::string &file_name, const PostProcess &post) const;
+
+    // save albedo, normal, depth, variance and sample count as <prefix>_<name>.pfm
+    // with_statistics: false if each pixel got a single estimate, whose variance and count mean nothing
+    void SaveAOVs(const std::string &prefix, bool with_statistics = true) const;
+
+private:
+    int width, height;
+    bool with_aovs;
+    // interleaved RGB / XYZ
+    std::vector<float> radiance, weight, luminance, luminance_sq;
+    std::vector<int> count;
+    std::vector<float> albedo, normal, depth;
+    std::vector<int> feature_count;
+};
+
+} // namespace RT
+
+#endif //RT_FILM_H
@@ -0,0 +1,45 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "./filter.h"
+#include "./debug.h"
+
+namespace RT {
+
+std::unique_ptr<Filter> Filter::Create(const std::string &name) {
+    if (name == "box") {
+        return std::make_unique<BoxFilter>();
+    } else if (name == "gaussian") {
+        return std::make_unique<GaussianFilter>();
+    } else if (name == "mitchell") {
+        return std::make_unique<MitchellFilter>();
+    } else {
+        throw std::runtime_error(fmt::format("unknown filter '{}', should be box, gaussian or mitchell", name));
+    }
+}
+
+float BoxFilter::Evaluate(float d) const {
+    // half open, so that a sample on the border of two pixels counts once
+    return -radius < d && d <= radius ? 1.f : 0.f;
+}
+
+GaussianFilter::GaussianFilter(float radius, float sigma) :
+        Filter(radius), alpha(1 / (2 * sigma * sigma)), edge(std::exp(-radius * radius / (2 * sigma * sigma))) {}
+
+float GaussianFilter::Evaluate(float d) const {
+    return std::abs(d) < radius ? std::exp(-alpha * d * d) - edge : 0.f;
+}
+
+float MitchellFilter::Evaluate(float d) const {
+    // the cubic is defined on [-2, 2]
+    const float x = std::abs(2 * d / radius);
+    if (x >= 2) {
+        return 0;
+    }
+    if (x >= 1) {
+        return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6;
+    }
+    return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6;
+}
+
+} // namespace RT
@@ -0,0 +1,60 @@
+#ifndef RT_FILTER_H
+#define RT_FILTER_H
+
+#include <memory>
+#include <string>
+
+namespace RT {
+
+// separable pixel reconstruction filter, a sample at offset (dx, dy) from a pixel center contributes to that pixel
+// with weight Evaluate(dx) * Evaluate(dy) if both offsets are within the radius
+class Filter {
+public:
+    explicit Filter(float radius) : radius(radius) {}
+    virtual ~Filter() = default;
+
+    [[nodiscard]] float Radius() const { return radius; }
+
+    // 1D profile, may be negative, zero outside the radius
+    [[nodiscard]] virtual float Evaluate(float d) const = 0;
+
+    // name is one of "box", "gaussian" and "mitchell"
+    static std::unique_ptr<Filter> Create(const std::string &name);
+
+protected:
+    float radius;
+};
+
+// each sample counts for the pixel it falls in
+class BoxFilter : public Filter {
+public:
+    BoxFilter() : Filter(0.5) {}
+
+    [[nodiscard]] float Evaluate(float d) const override;
+};
+
+// gaussian shifted down to reach zero at the radius
+class GaussianFilter : public Filter {
+public:
+    explicit GaussianFilter(float radius = 1.5, float sigma = 0.5);
+
+    [[nodiscard]] float Evaluate(float d) const override;
+
+private:
+    float alpha, edge;
+};
+
+// Mitchell-Netravali cubic, B = C = 1/3 by default
+class MitchellFilter : public Filter {
+public:
+    explicit MitchellFilter(float radius = 2, float b = 1.f / 3, float c = 1.f / 3) : Filter(radius), b(b), c(c) {}
+
+    [[nodiscard]] float Evaluate(float d) const override;
+
+private:
+    float b, c;
+};
+
+} // namespace RT
+
+#endif //RT_FILTER_H
@@ -1,8 +1,16 @@
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <lodepng.h>
 
 #include "image.h"
+#include "fmt/core.h"
 
 namespace RT {
 
@@ -13,11 +21,6 @@ unsigned char ReadByte(FILE *file) {
     return b;
 }
 
-void WriteByte(FILE *file, unsigned char b) {
-    int success = fwrite((void *)(&b), sizeof(unsigned char), 1, file);
-    assert(success == 1);
-}
-
 unsigned char ClampColorComponent(float c) {
     int tmp = int(c * 255);
 
@@ -32,46 +35,51 @@ unsigned char ClampColorComponent(float c) {
     return (unsigned char)tmp;
 }
 
+// write the whole file with a single call
+template<class Byte>
+bool write_bytes(const char *filename, const std::vector<Byte> &bytes) {
+    FILE *file = fopen(filename, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    size_t written = fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    return written == bytes.size();
+}
+
+template<class Byte, class T>
+void append(std::vector<Byte> &bytes, const T *value, size_t size) {
+    auto *p = reinterpret_cast<const Byte *>(value);
+    bytes.insert(bytes.end(), p, p + size);
+}
+
+template<class Byte, class T>
+void append(std::vector<Byte> &bytes, const T &value) {
+    append(bytes, &value, sizeof(T));
+}
+
 // Save and Load data type 2 Targa (.tga) files
 // (uncompressed, unmapped RGB images)
 
-void Image::SaveTGA(const char *filename) const {
+void Image::SaveTGA(const char *filename, const PostProcess &post) const {
     assert(filename != nullptr);
     // must end in .tga
     const char *ext = &filename[strlen(filename) - 4];
     assert(!strcmp(ext, ".tga"));
-    FILE *file = fopen(filename, "wb");
     // misc header information
-    for (int i = 0; i < 18; i++) {
-        if (i == 2)
-            WriteByte(file, 2);
-        else if (i == 12)
-            WriteByte(file, width % 256);
-        else if (i == 13)
-            WriteByte(file, width / 256);
-        else if (i == 14)
-            WriteByte(file, height % 256);
-        else if (i == 15)
-            WriteByte(file, height / 256);
-        else if (i == 16)
-            WriteByte(file, 24);
-        else if (i == 17)
-            WriteByte(file, 32);
-        else
-            WriteByte(file, 0);
-    }
-    // the data
+    std::vector<unsigned char> bytes(18, 0);
+    bytes[2] = 2;
+    bytes[12] = width % 256;
+    bytes[13] = width / 256;
+    bytes[14] = height % 256;
+    bytes[15] = height / 256;
+    bytes[16] = 24;
+    bytes[17] = 32;
+    // the data, note reversed order: b, g, r
     // flip y so that (0,0) is bottom left corner
-    for (int y = height - 1; y >= 0; y--) {
-        for (int x = 0; x < width; x++) {
-            Vector3f v = GetPixel(x, y);
-            // note reversed order: b, g, r
-            WriteByte(file, ClampColorComponent(v[2]));
-            WriteByte(file, ClampColorComponent(v[1]));
-            WriteByte(file, ClampColorComponent(v[0]));
-        }
-    }
-    fclose(file);
+    const int bgr[3] = {2, 1, 0};
+    encode8(bytes, post, bgr, true, 3 * width);
+    write_bytes(filename, bytes);
 }
 
 Image *Image::LoadTGA(const char *filename) {
@@ -124,29 +132,19 @@ Image *Image::LoadTGA(const char *filename) {
 // Save and Load PPM image files using magic number 'P6'
 // and having one comment line
 
-void Image::SavePPM(const char *filename) const {
+void Image::SavePPM(const char *filename, const PostProcess &post) const {
     assert(filename != nullptr);
     // must end in .ppm
     const char *ext = &filename[strlen(filename) - 4];
     assert(!strcmp(ext, ".ppm"));
-    FILE *file = fopen(filename, "w");
     // misc header information
-    assert(file != nullptr);
-    fprintf(file, "P6\n");
-    fprintf(file, "# Creator: Image::SavePPM()\n");
-    fprintf(file, "%d %d\n", width, height);
-    fprintf(file, "255\n");
+    std::string header = fmt::format("P6\n# Creator: Image::SavePPM()\n{} {}\n255\n", width, height);
+    std::vector<unsigned char> bytes(header.begin(), header.end());
     // the data
     // flip y so that (0,0) is bottom left corner
-    for (int y = height - 1; y >= 0; y--) {
-        for (int x = 0; x < width; x++) {
-            Vector3f v = GetPixel(x, y);
-            fputc(ClampColorComponent(v[0]), file);
-            fputc(ClampColorComponent(v[1]), file);
-            fputc(ClampColorComponent(v[2]), file);
-        }
-    }
-    fclose(file);
+    const int rgb[3] = {0, 1, 2};
+    encode8(bytes, post, rgb, true, 3 * width);
+    write_bytes(filename, bytes);
 }
 
 Image *Image::LoadPPM(const char *filename) {
@@ -222,17 +220,13 @@ struct BMPHeader {
     int biClrImportant;  /* Number of important colors.  If 0, all colors
                             are important */
 };
-int Image::SaveBMP(const char *filename) {
-    int i, j, ipos;
+int Image::SaveBMP(const char *filename, const PostProcess &post) const {
     int bytesPerLine;
-    unsigned char *line;
-    Vector3f *rgb = data;
-    FILE *file;
     struct BMPHeader bmph {};
 
     /* The length of each line must be a multiple of 4 bytes */
 
-    bytesPerLine = (3 * (width + 1) / 4) * 4;
+    bytesPerLine = ((3 * width + 3) / 4) * 4;
 
     strcpy(bmph.bfType, "BM");
     bmph.bfOffBits = 54;
@@ -250,54 +244,273 @@ int Image::SaveBMP(const char *filename) {
     bmph.biClrUsed = 0;
     bmph.biClrImportant = 0;
 
-    file = fopen(filename, "wb");
-    if (file == NULL)
-        return (0);
-
-    fwrite(&bmph.bfType, 2, 1, file);
-    fwrite(&bmph.bfSize, 4, 1, file);
-    fwrite(&bmph.bfReserved, 4, 1, file);
-    fwrite(&bmph.bfOffBits, 4, 1, file);
-    fwrite(&bmph.biSize, 4, 1, file);
-    fwrite(&bmph.biWidth, 4, 1, file);
-    fwrite(&bmph.biHeight, 4, 1, file);
-    fwrite(&bmph.biPlanes, 2, 1, file);
-    fwrite(&bmph.biBitCount, 2, 1, file);
-    fwrite(&bmph.biCompression, 4, 1, file);
-    fwrite(&bmph.biSizeImage, 4, 1, file);
-    fwrite(&bmph.biXPelsPerMeter, 4, 1, file);
-    fwrite(&bmph.biYPelsPerMeter, 4, 1, file);
-    fwrite(&bmph.biClrUsed, 4, 1, file);
-    fwrite(&bmph.biClrImportant, 4, 1, file);
-
-    line = (unsigned char *)malloc(bytesPerLine);
-    if (line == NULL) {
-        fprintf(stderr, "Can'indices allocate memory for BMP file.\n");
-        return (0);
+    std::vector<unsigned char> bytes;
+    bytes.reserve(bmph.bfSize);
+    append(bytes, bmph.bfType, 2);
+    append(bytes, &bmph.bfSize, 4);
+    append(bytes, &bmph.bfReserved, 4);
+    append(bytes, &bmph.bfOffBits, 4);
+    append(bytes, &bmph.biSize, 4);
+    append(bytes, &bmph.biWidth, 4);
+    append(bytes, &bmph.biHeight, 4);
+    append(bytes, &bmph.biPlanes, 2);
+    append(bytes, &bmph.biBitCount, 2);
+    append(bytes, &bmph.biCompression, 4);
+    append(bytes, &bmph.biSizeImage, 4);
+    append(bytes, &bmph.biXPelsPerMeter, 4);
+    append(bytes, &bmph.biYPelsPerMeter, 4);
+    append(bytes, &bmph.biClrUsed, 4);
+    append(bytes, &bmph.biClrImportant, 4);
+
+    // bottom-up rows of b, g, r
+    const int bgr[3] = {2, 1, 0};
+    encode8(bytes, post, bgr, false, bytesPerLine);
+    return write_bytes(filename, bytes) ? 1 : 0;
+}
+
+void Image::SavePNG(const char *filename, const PostProcess &post) const {
+    std::vector<unsigned char> bytes;
+    const int rgb[3] = {0, 1, 2};
+    encode8(bytes, post, rgb, true, 3 * width);
+    auto err_code = lodepng::encode(filename, bytes, width, height, LCT_RGB);
+    if (err_code != 0) {
+        throw std::runtime_error(fmt::format("save png '{}' failed: {}", filename, lodepng_error_text(err_code)));
+    }
+}
+
+void Image::encode8(std::vector<unsigned char> &bytes, const PostProcess &post, const int order[3], bool top_down,
+                    int row_stride) const {
+    const std::vector<unsigned char> &lut = post.EncodeTable();
+    const int lut_size = PostProcess::EncodeTableSize();
+
+    const size_t start = bytes.size();
+    bytes.resize(start + (size_t) row_stride * height, 0);
+    const float *pixels = &data[0][0];
+#pragma omp parallel for schedule(static) default(none) shared(bytes, post, lut, lut_size, order, pixels, top_down, row_stride, start)
+    for (int y = 0; y < height; y++) {
+        std::vector<float> row(pixels + 3 * (size_t) y * width, pixels + 3 * (size_t) (y + 1) * width);
+        post.Apply(row.data(), 3 * width);
+        std::vector<uint16_t> index(3 * width);
+        // clamp and scale in one branchless loop, NaN goes to 0
+        for (int i = 0; i < 3 * width; i++) {
+            float v = row[i] > 0 ? row[i] : 0;
+            v = v < 1 ? v : 1;
+            index[i] = (uint16_t) (v * (lut_size - 1));
+        }
+        unsigned char *dst = bytes.data() + start + (size_t) row_stride * (top_down ? height - 1 - y : y);
+        for (int x = 0; x < width; x++) {
+            dst[3 * x] = lut[index[3 * x + order[0]]];
+            dst[3 * x + 1] = lut[index[3 * x + order[1]]];
+            dst[3 * x + 2] = lut[index[3 * x + order[2]]];
+        }
+    }
+}
+
+// HDR output, the whole file is assembled in memory and written at once
+
+namespace {
+
+void write_file(const char *filename, const std::vector<char> &bytes) {
+    if (!write_bytes(filename, bytes)) {
+        throw std::runtime_error(fmt::format("failed to write '{}'", filename));
+    }
+}
+
+void append_string(std::vector<char> &bytes, const char *str) {
+    bytes.insert(bytes.end(), str, str + strlen(str) + 1);
+}
+
+// IEEE 754 binary16 with round to nearest even, overflow goes to infinity
+uint16_t float_to_half(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mantissa = x & 0x7fffff;
+    const int exponent = (int) ((x >> 23) & 0xff);
+    if (exponent == 0xff) {
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    int e = exponent - 127 + 15;
+    if (e >= 31) {
+        return sign | 0x7c00;
+    }
+    int shift = 13;
+    uint32_t h;
+    if (e <= 0) {
+        // subnormal half
+        if (e < -10) return sign;
+        mantissa |= 0x800000;
+        shift = 14 - e;
+        h = mantissa >> shift;
+    } else {
+        h = ((uint32_t) e << 10) | (mantissa >> shift);
+    }
+    const uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1))) {
+        h++;  // a carry into the exponent is still the correctly rounded value
+    }
+    return sign | h;
+}
+
+// run length encoding of OpenEXR RLE_COMPRESSION, after byte reordering and delta prediction
+void exr_rle_compress(const std::vector<char> &raw, std::vector<char> &tmp, std::vector<char> &out) {
+    const int size = (int) raw.size();
+    tmp.resize(size);
+    for (int i = 0, half = (size + 1) / 2; i < size; i++) {
+        tmp[i % 2 ? half + i / 2 : i / 2] = raw[i];
+    }
+    for (int i = size - 1; i > 0; i--) {
+        tmp[i] = (char) ((unsigned char) tmp[i] - (unsigned char) tmp[i - 1] + 128);
     }
 
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            ipos = (width * i + j);
-            line[3 * j] = ClampColorComponent(rgb[ipos][2]);
-            line[3 * j + 1] = ClampColorComponent(rgb[ipos][1]);
-            line[3 * j + 2] = ClampColorComponent(rgb[ipos][0]);
+    const int min_run = 3, max_run = 127;
+    out.clear();
+    int run_start = 0, run_end = 1;
+    while (run_start < size) {
+        while (run_end < size && tmp[run_start] == tmp[run_end] && run_end - run_start - 1 < max_run) {
+            run_end++;
+        }
+        if (run_end - run_start >= min_run) {
+            out.push_back((char) (run_end - run_start - 1));
+            out.push_back(tmp[run_start]);
+            run_start = run_end;
+        } else {
+            while (run_end < size &&
+                   (run_end + 1 >= size || tmp[run_end] != tmp[run_end + 1] ||
+                    run_end + 2 >= size || tmp[run_end + 1] != tmp[run_end + 2]) &&
+                   run_end - run_start < max_run) {
+                run_end++;
+            }
+            out.push_back((char) (run_start - run_end));
+            out.insert(out.end(), tmp.begin() + run_start, tmp.begin() + run_end);
+            run_start = run_end;
         }
-        fwrite(line, bytesPerLine, 1, file);
+        run_end++;
     }
+}
+
+void append_exr_attribute(std::vector<char> &bytes, const char *name, const char *type, int size) {
+    append_string(bytes, name);
+    append_string(bytes, type);
+    append(bytes, (int32_t) size);
+}
+
+} // anonymous namespace
 
-    free(line);
+void Image::SavePFM(const char *filename) const {
+    std::string header = fmt::format("PF\n{} {}\n-1.0\n", width, height);
+    std::vector<char> bytes(header.begin(), header.end());
+    // PFM rows go from bottom to top like ours, no flip needed
+    const char *pixels = reinterpret_cast<const char *>(data);
+    static_assert(sizeof(Vector3f) == 3 * sizeof(float));
+    bytes.insert(bytes.end(), pixels, pixels + sizeof(Vector3f) * width * height);
+    write_file(filename, bytes);
+}
+
+Image *Image::LoadPFM(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr) {
+        throw std::runtime_error(fmt::format("cannot open '{}'", filename));
+    }
+    int width = 0, height = 0;
+    float scale = 0;
+    if (fscanf(file, "PF %d %d %f", &width, &height, &scale) != 3 || fgetc(file) == EOF ||
+        width <= 0 || height <= 0 || scale >= 0) {
+        fclose(file);
+        throw std::runtime_error(fmt::format("'{}' is not a little endian RGB PFM file", filename));
+    }
+    auto *answer = new Image(width, height);
+    size_t read = fread(answer->data, sizeof(Vector3f), width * height, file);
     fclose(file);
+    if (read != (size_t) width * height) {
+        delete answer;
+        throw std::runtime_error(fmt::format("'{}' is truncated", filename));
+    }
+    return answer;
+}
+
+void Image::SaveEXR(const char *filename) const {
+    std::vector<char> bytes;
+    append(bytes, (int32_t) 20000630);
+    append(bytes, (int32_t) 2);  // single part scanline file
 
-    return (1);
+    // channels are stored in alphabetical order
+    const char *channels[3] = {"B", "G", "R"};
+    append_exr_attribute(bytes, "channels", "chlist", 3 * (2 + 16) + 1);
+    for (const char *channel: channels) {
+        append_string(bytes, channel);
+        append(bytes, (int32_t) 1);  // HALF
+        append(bytes, (int32_t) 0);  // pLinear and reserved
+        append(bytes, (int32_t) 1);
+        append(bytes, (int32_t) 1);
+    }
+    bytes.push_back(0);
+    append_exr_attribute(bytes, "compression", "compression", 1);
+    bytes.push_back(1);  // RLE_COMPRESSION
+    for (const char *window: {"dataWindow", "displayWindow"}) {
+        append_exr_attribute(bytes, window, "box2i", 16);
+        append(bytes, (int32_t) 0);
+        append(bytes, (int32_t) 0);
+        append(bytes, (int32_t) (width - 1));
+        append(bytes, (int32_t) (height - 1));
+    }
+    append_exr_attribute(bytes, "lineOrder", "lineOrder", 1);
+    bytes.push_back(0);  // INCREASING_Y
+    append_exr_attribute(bytes, "pixelAspectRatio", "float", 4);
+    append(bytes, 1.0f);
+    append_exr_attribute(bytes, "screenWindowCenter", "v2f", 8);
+    append(bytes, 0.0f);
+    append(bytes, 0.0f);
+    append_exr_attribute(bytes, "screenWindowWidth", "float", 4);
+    append(bytes, 1.0f);
+    bytes.push_back(0);
+
+    // RLE compresses one scanline per chunk, the offset table is filled as chunks are appended
+    const size_t table_start = bytes.size();
+    bytes.resize(table_start + sizeof(uint64_t) * height);
+    std::vector<char> raw(3 * sizeof(uint16_t) * width), tmp, packed;
+    for (int line = 0; line < height; line++) {
+        const uint64_t offset = bytes.size();
+        memcpy(bytes.data() + table_start + sizeof(uint64_t) * line, &offset, sizeof(offset));
+        // EXR scanlines go from top to bottom
+        const Vector3f *row = data + (height - 1 - line) * width;
+        auto *halves = reinterpret_cast<uint16_t *>(raw.data());
+        for (int c = 0; c < 3; c++) {
+            for (int x = 0; x < width; x++) {
+                halves[c * width + x] = float_to_half(row[x][2 - c]);
+            }
+        }
+        exr_rle_compress(raw, tmp, packed);
+        // chunks that do not shrink are stored uncompressed
+        const std::vector<char> &chunk = packed.size() < raw.size() ? packed : raw;
+        append(bytes, (int32_t) line);
+        append(bytes, (int32_t) chunk.size());
+        bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+    }
+    write_file(filename, bytes);
 }
 
-void Image::SaveImage(const char *filename) {
+void Image::SaveImage(const char *filename, const PostProcess &post) {
     int len = strlen(filename);
-    if (strcmp(".bmp", filename + len - 4) == 0) {
-        SaveBMP(filename);
+    const char *ext = len >= 4 ? filename + len - 4 : filename;
+    const bool is_float = strcmp(".pfm", ext) == 0 || strcmp(".exr", ext) == 0;
+    if (is_float && post.Exposure() != 0) {
+        Image exposed(width, height);
+        std::copy(data, data + width * height, exposed.data);
+        post.Expose(&exposed.data[0][0], 3 * width * height);
+        exposed.SaveImage(filename);
+    } else if (strcmp(".pfm", ext) == 0) {
+        SavePFM(filename);
+    } else if (strcmp(".exr", ext) == 0) {
+        SaveEXR(filename);
+    } else if (strcmp(".png", ext) == 0) {
+        SavePNG(filename, post);
+    } else if (strcmp(".bmp", ext) == 0) {
+        SaveBMP(filename, post);
+    } else if (strcmp(".ppm", ext) == 0) {
+        SavePPM(filename, post);
     } else {
-        SaveTGA(filename);
+        SaveTGA(filename, post);
     }
 }
 
@@ -2,8 +2,10 @@
 #define IMAGE_H
 
 #include <cassert>
+#include <vector>
 
 #include "vecmath.h"
+#include "post_process.h"
 
 namespace RT {
 
@@ -43,17 +45,32 @@ public:
 
     static Image *LoadPPM(const char *filename);
 
-    void SavePPM(const char *filename) const;
+    void SavePPM(const char *filename, const PostProcess &post = PostProcess()) const;
 
     static Image *LoadTGA(const char *filename);
 
-    void SaveTGA(const char *filename) const;
+    void SaveTGA(const char *filename, const PostProcess &post = PostProcess()) const;
 
-    int SaveBMP(const char *filename);
+    int SaveBMP(const char *filename, const PostProcess &post = PostProcess()) const;
 
-    void SaveImage(const char *filename);
+    void SavePNG(const char *filename, const PostProcess &post = PostProcess()) const;
+
+    // linear float RGB, little endian, rows from bottom to top
+    static Image *LoadPFM(const char *filename);
+
+    void SavePFM(const char *filename) const;
+
+    // half float RGB scanline EXR with RLE compression, readable by OpenEXR
+    void SaveEXR(const char *filename) const;
+
+    // pixels hold linear radiance, float formats only get the exposure of post, 8-bit formats all of it
+    void SaveImage(const char *filename, const PostProcess &post = PostProcess());
 
 private:
+    // append the post processed 8-bit pixels to bytes, with channels picked by order and rows padded to row_stride
+    void encode8(std::vector<unsigned char> &bytes, const PostProcess &post, const int order[3], bool top_down,
+                 int row_stride) const;
+
     int width;
     int height;
     Vector3f *data;
@@ -0,0 +1,118 @@
+#ifndef RT_KD_TREE_HPP
+#define RT_KD_TREE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <Vector3f.h>
+
+namespace RT {
+
+// A balanced kd-tree over a set of points, stored implicitly in an array:
+// the node of range [begin, end) is at (begin + end) / 2, its children are the two halves
+// No child pointers are stored, and a query walks contiguous memory near the leaves
+class KdTree {
+public:
+    // build the tree over points[0, count), the upper levels are built in parallel
+    void Build(const Vector3f *points, int count) {
+        std::vector<int> order(count);
+        for (int i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        node_axis.resize(count);
+#pragma omp parallel default(none) shared(points, count, order)
+#pragma omp single
+        build(points, order, 0, count);
+
+        node_point.resize(count);
+        node_index = std::move(order);
+#pragma omp parallel for schedule(static) default(none) shared(points, count)
+        for (int i = 0; i < count; i++) {
+            node_point[i] = points[node_index[i]];
+        }
+    }
+
+    // for each point within radius of p, invoke f(index of the point)
+    template<typename F>
+    void FindInRadius(const Vector3f &p, float radius, F &&f) const {
+        const float radius2 = radius * radius;
+        // the tree has at most 32 levels, and each level pushes at most 2 ranges
+        int stack[128];
+        int top = 0;
+        stack[top++] = 0;
+        stack[top++] = (int) node_index.size();
+        while (top > 0) {
+            int end = stack[--top], begin = stack[--top];
+            if (begin >= end) continue;
+            int mid = (begin + end) / 2;
+            const Vector3f &q = node_point[mid];
+            if ((q - p).squaredLength() <= radius2) {
+                f(node_index[mid]);
+            }
+            float d = p[node_axis[mid]] - q[node_axis[mid]];
+            if (d <= radius) {
+                stack[top++] = begin;
+                stack[top++] = mid;
+            }
+            if (d >= -radius) {
+                stack[top++] = mid + 1;
+                stack[top++] = end;
+            }
+        }
+    }
+
+    [[nodiscard]] int Size() const {
+        return (int) node_index.size();
+    }
+
+    void Reset() {
+        node_point.clear();
+        node_index.clear();
+        node_axis.clear();
+    }
+
+private:
+    // split [begin, end) at the median of the axis with the largest extent
+    void build(const Vector3f *points, std::vector<int> &order, int begin, int end) {
+        if (begin >= end) return;
+        Vector3f lo(INFINITY), hi(-INFINITY);
+        for (int i = begin; i < end; i++) {
+            const Vector3f &p = points[order[i]];
+            for (int a = 0; a < 3; a++) {
+                lo[a] = std::min(lo[a], p[a]);
+                hi[a] = std::max(hi[a], p[a]);
+            }
+        }
+        Vector3f extent = hi - lo;
+        int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+
+        int mid = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b) {
+            return points[a][axis] < points[b][axis];
+        });
+        node_axis[mid] = (uint8_t) axis;
+
+        if (end - begin > parallel_threshold) {
+#pragma omp task default(none) shared(points, order) firstprivate(begin, mid)
+            build(points, order, begin, mid);
+#pragma omp task default(none) shared(points, order) firstprivate(mid, end)
+            build(points, order, mid + 1, end);
+#pragma omp taskwait
+        } else {
+            build(points, order, begin, mid);
+            build(points, order, mid + 1, end);
+        }
+    }
+
+    static constexpr int parallel_threshold = 1 << 14;
+
+    std::vector<Vector3f> node_point;  // copies of the points, in tree order
+    std::vector<int> node_index;       // index of the point in the input
+    std::vector<uint8_t> node_axis;    // split axis of each node
+};
+
+}
+
+#endif //RT_KD_TREE_HPP
@@ -48,6 +48,34 @@ Vector3f RNG::RandNormalizedVector() {
     return Vector3f{RandNormalFloat(), RandNormalFloat(), RandNormalFloat()}.normalized();
 }
 
+float sample_sphere_cone(const Vector3f &ref, const Vector3f &center, float radius, RNG &rng, Vector3f &point) {
+    Vector3f ref_to_center = center - ref;
+    float dist2 = ref_to_center.squaredLength();
+    if (dist2 <= radius * radius) return 0.f;
+
+    float dist = std::sqrt(dist2);
+    float cos_max = std::sqrt(1 - radius * radius / dist2);
+    float cos_theta = 1 - rng.RandUniformFloat() * (1 - cos_max);
+    float sin_theta = std::sqrt(std::max(0.f, 1 - cos_theta * cos_theta));
+    float phi = 2 * (float) M_PI * rng.RandUniformFloat();
+    Vector3f w = ref_to_center / dist, u, v;
+    orthonormal_basis(w, u, v);
+    Vector3f dir = (u * std::cos(phi) + v * std::sin(phi)) * sin_theta + w * cos_theta;
+
+    // the first intersection of the sampled direction with the sphere
+    float tp = dist * cos_theta;
+    float t = tp - std::sqrt(std::max(0.f, radius * radius - (dist2 - tp * tp)));
+    point = ref + dir * t;
+    return 1 / (2 * (float) M_PI * (1 - cos_max));
+}
+
+float sphere_cone_pdf(const Vector3f &ref, const Vector3f &center, float radius) {
+    float dist2 = (center - ref).squaredLength();
+    if (dist2 <= radius * radius) return 0.f;
+    float cos_max = std::sqrt(1 - radius * radius / dist2);
+    return 1 / (2 * (float) M_PI * (1 - cos_max));
+}
+
 Vector3f parse_vector3f(const std::string &str) {
     Vector3f v;
     const char *start = str.c_str();
@@ -1,6 +1,8 @@
 #ifndef RT_MATH_UTIL_H
 #define RT_MATH_UTIL_H
 
+#include <cstdint>
+#include <cstring>
 #include <random>
 #include <string>
 
@@ -39,6 +41,13 @@ inline float clamp1(float x) {
     return x;
 }
 
+// uniformly sample the cone subtended by a sphere seen from ref, store the nearest point on the sphere
+// return the density w.r.t. solid angle, or 0 if ref is inside the sphere
+float sample_sphere_cone(const Vector3f &ref, const Vector3f &center, float radius, RNG &rng, Vector3f &point);
+
+// density of sample_sphere_cone(), 0 if ref is inside the sphere
+float sphere_cone_pdf(const Vector3f &ref, const Vector3f &center, float radius);
+
 Vector3f parse_vector3f(const std::string &str);
 
 Vector2f parse_vector2f(const std::string &str);
@@ -50,15 +59,29 @@ inline float tri_det(const Vector3f &v0, const Vector3f &v1, const Vector3f &v2)
            v0[2] * (v1[0] * v2[1] - v1[1] * v2[0]);
 }
 
-inline Vector3f gamma_correct(const Vector3f &v, float gamma) {
-    return {
-        std::pow(v.x(), 1 / gamma),
-        std::pow(v.y(), 1 / gamma),
-        std::pow(v.z(), 1 / gamma),
-    };
+inline float fsquare(float x) { return x * x; }
+
+// false for NaN and infinity, by the exponent bits because std::isfinite is folded to true under -Ofast
+inline bool is_finite(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7f800000u) != 0x7f800000u;
 }
 
-inline float fsquare(float x) { return x * x; }
+inline float luminance(const Vector3f &v) { return 0.2126f * v.x() + 0.7152f * v.y() + 0.0722f * v.z(); }
+
+// build u, v such that (u, v, n) is an orthonormal basis, n should be normalized
+inline void orthonormal_basis(const Vector3f &n, Vector3f &u, Vector3f &v) {
+    u = std::abs(n.x()) > 0.5f ? Vector3f(n.y(), -n.x(), 0) : Vector3f(0, n.z(), -n.y());
+    u.normalize();
+    v = Vector3f::cross(n, u);
+}
+
+// power heuristic (beta = 2) of multiple importance sampling, weight of the strategy with pdf_a
+inline float power_heuristic(float pdf_a, float pdf_b) {
+    float a2 = pdf_a * pdf_a, b2 = pdf_b * pdf_b;
+    return a2 + b2 > 0 ? a2 / (a2 + b2) : 0.f;
+}
 
 } // namespace RT
 
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "./post_process.h"
+#include "./debug.h"
+
+namespace RT {
+
+PostProcess::PostProcess(float gamma, float exposure, const std::string &tonemap, bool srgb) :
+        gamma(gamma), exposure(exposure), scale(std::exp2(exposure)), srgb(srgb),
+        encode_table(EncodeTableSize()) {
+    if (tonemap == "none") {
+        this->tonemap = ToneMap::None;
+    } else if (tonemap == "reinhard") {
+        this->tonemap = ToneMap::Reinhard;
+    } else if (tonemap == "aces") {
+        this->tonemap = ToneMap::ACES;
+    } else {
+        throw std::runtime_error(fmt::format("unknown tone map '{}', should be none, reinhard or aces", tonemap));
+    }
+    if (gamma <= 0) {
+        throw std::runtime_error(fmt::format("invalid gamma {}", gamma));
+    }
+
+    // the curve is evaluated once per table entry instead of once per pixel, values are truncated like before
+    for (int i = 0; i < EncodeTableSize(); i++) {
+        const float v = (float) i / (EncodeTableSize() - 1);
+        float encoded;
+        if (srgb) {
+            encoded = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1 / 2.4f) - 0.055f;
+        } else {
+            encoded = std::pow(v, 1 / gamma);
+        }
+        // the epsilon keeps float error in the sRGB curve from truncating white to 254
+        encode_table[i] = (unsigned char) std::min(std::max((int) (encoded * 255 + 1e-4f), 0), 255);
+    }
+}
+
+void PostProcess::Expose(float *values, int count) const {
+    for (int i = 0; i < count; i++) {
+        values[i] *= scale;
+    }
+}
+
+void PostProcess::Apply(float *values, int count) const {
+    // branchless per-channel operators, so that the loops vectorize
+    switch (tonemap) {
+        case ToneMap::None:
+            Expose(values, count);
+            break;
+        case ToneMap::Reinhard:
+            for (int i = 0; i < count; i++) {
+                float v = values[i] * scale;
+                v = v > 0 ? v : 0;
+                values[i] = v / (1 + v);
+            }
+            break;
+        case ToneMap::ACES:
+            // fit of the ACES filmic curve by Krzysztof Narkowicz
+            for (int i = 0; i < count; i++) {
+                float v = values[i] * scale;
+                v = v > 0 ? v : 0;
+                values[i] = v * (2.51f * v + 0.03f) / (v * (2.43f * v + 0.59f) + 0.14f);
+            }
+            break;
+    }
+}
+
+} // namespace RT
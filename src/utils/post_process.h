@@ -0,0 +1,42 @@
+#ifndef RT_POST_PROCESS_H
+#define RT_POST_PROCESS_H
+
+#include <string>
+#include <vector>
+
+namespace RT {
+
+// Turns linear radiance into display values when an image is saved: exposure, tone mapping, then the encoding curve
+// Renderers keep linear values, so the look can be changed without re-rendering (see RT_merge)
+class PostProcess {
+public:
+    enum class ToneMap {None, Reinhard, ACES};
+
+    // exposure is in stops, tonemap is none, reinhard or aces
+    // srgb: encode with the sRGB curve instead of the power 1 / gamma
+    explicit PostProcess(float gamma = 1, float exposure = 0, const std::string &tonemap = "none", bool srgb = false);
+
+    // scale by the exposure in place, the only step applied to float outputs
+    void Expose(float *values, int count) const;
+
+    // exposure and tone mapping in place, results are display-linear in [0, 1] unless the tone map is none
+    void Apply(float *values, int count) const;
+
+    // 8-bit code of a display-linear value v in [0, 1] is EncodeTable()[int(v * (EncodeTableSize() - 1))]
+    [[nodiscard]] const std::vector<unsigned char> &EncodeTable() const { return encode_table; }
+    [[nodiscard]] static constexpr int EncodeTableSize() { return 1 << 16; }
+
+    [[nodiscard]] float Gamma() const { return gamma; }
+    [[nodiscard]] float Exposure() const { return exposure; }
+    [[nodiscard]] ToneMap GetToneMap() const { return tonemap; }
+
+private:
+    float gamma, exposure, scale;
+    ToneMap tonemap;
+    bool srgb;
+    std::vector<unsigned char> encode_table;
+};
+
+} // namespace RT
+
+#endif //RT_POST_PROCESS_H
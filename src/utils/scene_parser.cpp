@@ -1,5 +1,8 @@
 #include <cassert>
+#include <exception>
+#include <filesystem>
 #include <memory>
+#include <unordered_set>
 
 #include "yaml-cpp/yaml.h"
 
@@ -54,8 +57,42 @@ void SceneParser::parse_light(const YAML::Node &node) {
     }
 }
 
+// every field of a material, exactly, so that equal keys mean interchangeable materials
+static std::string material_content(const Material &m) {
+    auto vec = [](const Vector3f &v) { return fmt::format("{} {} {}", v.x(), v.y(), v.z()); };
+    return fmt::format("{}|{}|{}|{}|{}|{}|{}|{}", (int) m.illumination_model, vec(m.ambientColor), vec(m.diffuseColor),
+                       vec(m.specularColor), vec(m.emissionColor), m.shininess, m.refraction, m.name);
+}
+
+// spellings of the same path map to the same texture
+static std::string texture_key(const std::string &file) {
+    return std::filesystem::path(file).lexically_normal().string();
+}
+
+// the files of all texture nodes under node, each once, in the order they appear
+static void collect_texture_files(const YAML::Node &node, std::vector<std::string> &files,
+                                  std::unordered_set<std::string> &seen) {
+    if (node.IsMap()) {
+        for (const auto &kv: node) {
+            const auto key = kv.first.as<std::string>();
+            if ((key == "texture" || key == "normal_texture") && kv.second.IsMap() && kv.second["file"]) {
+                auto file = texture_key(kv.second["file"].as<std::string>());
+                if (seen.insert(file).second) {
+                    files.push_back(file);
+                }
+            } else {
+                collect_texture_files(kv.second, files, seen);
+            }
+        }
+    } else if (node.IsSequence()) {
+        for (const auto &sub_node: node) {
+            collect_texture_files(sub_node, files, seen);
+        }
+    }
+}
+
 Material *SceneParser::parse_material(const YAML::Node &node) {
-    auto material = new Material((Material::IlluminationModel) node["illum"].as<int>());
+    auto material = std::make_unique<Material>((Material::IlluminationModel) node["illum"].as<int>());
     if (node["Ka"]) material->ambientColor = parse_vector3f(node["Ka"].as<std::string>());
     if (node["Kd"]) material->diffuseColor = parse_vector3f(node["Kd"].as<std::string>());
     if (node["Ks"]) material->specularColor = parse_vector3f(node["Ks"].as<std::string>());
@@ -63,18 +100,67 @@ Material *SceneParser::parse_material(const YAML::Node &node) {
     if (node["Ns"]) material->shininess = node["Ns"].as<float>();
     if (node["Ni"]) material->refraction = node["Ni"].as<float>();
     if (node["name"]) material->name = node["name"].as<std::string>();
-    all_materials.emplace_back(material);  // transfer ownership to all_materials
-    return material;
+
+    auto &shared = materials_by_content[material_content(*material)];
+    if (shared == nullptr) {
+        shared = all_materials.emplace_back(std::move(material)).get();  // transfer ownership to all_materials
+    }
+    return shared;
+}
+
+void SceneParser::SetTextureCache(const std::string &directory, size_t budget) {
+    texture_cache = std::make_unique<TextureCache>(directory, budget);
 }
 
 Texture *SceneParser::parse_texture(const YAML::Node &node) {
     if (node) {
-        return all_textures.emplace_back(std::make_unique<MappedTexture>(node["file"].as<std::string>(), gamma)).get();
+        const auto file = texture_key(node["file"].as<std::string>());
+        auto &texture = textures_by_file[file];
+        if (texture == nullptr) {  // not seen by load_textures()
+            texture = all_textures.emplace_back(texture_cache
+                    ? std::make_unique<MappedTexture>(file, gamma, *texture_cache)
+                    : std::make_unique<MappedTexture>(file, gamma)).get();
+        }
+        return texture;
     } else {
         return nullptr;
     }
 }
 
+void SceneParser::load_textures(const YAML::Node &node) {
+    std::vector<std::string> files;
+    std::unordered_set<std::string> seen;
+    collect_texture_files(node, files, seen);
+    for (auto it = files.begin(); it != files.end();) {
+        it = textures_by_file.count(*it) ? files.erase(it) : it + 1;
+    }
+
+    const int num_files = (int) files.size();
+    const float texture_gamma = gamma;
+    TextureCache *cache = texture_cache.get();
+    std::vector<std::unique_ptr<Texture>> textures(num_files);
+    // exceptions cannot leave the parallel loop, the first one is thrown after it
+    std::vector<std::exception_ptr> errors(num_files);
+#pragma omp parallel for schedule(dynamic) default(none) shared(num_files, files, texture_gamma, cache, textures, errors)
+    for (int i = 0; i < num_files; i++) {
+        try {
+            textures[i] = cache != nullptr
+                    ? std::make_unique<MappedTexture>(files[i], texture_gamma, *cache)
+                    : std::make_unique<MappedTexture>(files[i], texture_gamma);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    }
+    for (const auto &error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    for (int i = 0; i < num_files; i++) {
+        textures_by_file[files[i]] = all_textures.emplace_back(std::move(textures[i])).get();
+    }
+}
+
 std::unique_ptr<Object3D> SceneParser::parse_obj(const YAML::Node &node) {
     const std::string &node_type = node["type"].as<std::string>();
 
@@ -164,12 +250,19 @@ void SceneParser::parse(const std::string &scene_file) {
     if (gamma_node) gamma = gamma_node.as<float>();
 
     YAML::Node world_node = root_node["world"];
+    load_textures(world_node);
     auto world_group = new Group;
     for (const auto &obj_node: world_node) {
         world_group->objects.emplace_back(parse_obj(obj_node));
     }
     scene.reset(world_group);
 
+    std::vector<const SimpleObject3D *> emitters;
+    scene->CollectEmitters(emitters);
+    for (const SimpleObject3D *emitter: emitters) {
+        object_lights.emplace_back(std::make_unique<ObjectLight>(emitter));
+    }
+
     YAML::Node lights_node = root_node["lights"];
     if (lights_node) {
         for (const auto &light_node: lights_node) {
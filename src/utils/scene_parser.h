@@ -4,11 +4,13 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 #include "core/camera.h"
 #include "core/light.h"
 #include "core/material.h"
 #include "core/texture.h"
+#include "core/texture_cache.h"
 #include "objects/object3d.h"
 
 namespace YAML {
@@ -21,6 +23,9 @@ class SceneParser {
 public:
     SceneParser() = default;
 
+    // read textures through a cache of converted files in directory, keeping about budget bytes of them in memory
+    void SetTextureCache(const std::string &directory, size_t budget);
+
     void parse(const std::string &scene_file);
 
     float gamma = 2.2;
@@ -28,6 +33,7 @@ public:
     std::unique_ptr<Camera> camera;  // use pointer because it is an abstract class
     std::unique_ptr<Object3D> scene; // same as above
     std::vector<std::unique_ptr<Light>> lights;
+    std::vector<std::unique_ptr<ObjectLight>> object_lights;  // emissive objects in the scene
 
 private:
     std::unique_ptr<Object3D> parse_obj(const YAML::Node &node);
@@ -35,10 +41,16 @@ private:
     std::unique_ptr<Camera> parse_camera(const YAML::Node &node);
     Material *parse_material(const YAML::Node &node); // no ownership transfer, no need of unique_ptr
     Texture *parse_texture(const YAML::Node &node);
+    // decode all textures referenced under node at once, in parallel
+    void load_textures(const YAML::Node &node);
     void parse_light(const YAML::Node &node);
 
     std::vector<std::unique_ptr<Material>> all_materials;
+    std::unique_ptr<TextureCache> texture_cache;  // outlives the textures mapped through it
     std::vector<std::unique_ptr<Texture>> all_textures;
+    // objects referring to the same texture file, or to materials of the same content, share them
+    std::unordered_map<std::string, Texture *> textures_by_file;
+    std::unordered_map<std::string, Material *> materials_by_content;
 };
 
 } // namespace RT
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+#include <Vector3f.h>
+
+#include "utils/accumulation_buffer.h"
+
+namespace RT::testing {
+
+TEST(AccumulationBuffer, MergeWeightsBySampleCount) {
+    AccumulationBuffer a(2, 1, 2.2), b(2, 1, 2.2);
+    a.AddSamples(0, 0, Vector3f(3, 0, 0), 3, 3);  // 3 samples of 1
+    b.AddSamples(0, 0, Vector3f(0, 0, 0), 1, 1);  // 1 sample of 0
+    b.AddSamples(1, 0, Vector3f(2, 4, 6), 2, 2);
+    a.Merge(b);
+
+    EXPECT_FLOAT_EQ(a.Mean(0, 0).x(), 0.75);
+    EXPECT_EQ(a.Count(0, 0), 4);
+    EXPECT_FLOAT_EQ(a.Mean(1, 0).z(), 3);
+    EXPECT_EQ(a.Count(1, 0), 2);
+
+    AccumulationBuffer c(1, 1, 2.2);
+    EXPECT_THROW(a.Merge(c), std::runtime_error);
+    EXPECT_FLOAT_EQ(c.Mean(0, 0).x(), 0);
+}
+
+TEST(AccumulationBuffer, MergeWeightsByFilterWeight) {
+    // samples splatted by a filter: the weights, not the counts, normalize the sums
+    AccumulationBuffer a(1, 1, 2.2), b(1, 1, 2.2);
+    a.AddSamples(0, 0, Vector3f(0.5, 0, 0), 0.5, 4);  // weight 0.5 of radiance 1
+    b.AddSamples(0, 0, Vector3f(0, 0, 0), 1.5, 4);    // weight 1.5 of radiance 0
+    a.Merge(b);
+
+    EXPECT_FLOAT_EQ(a.Mean(0, 0).x(), 0.25);
+    EXPECT_EQ(a.Count(0, 0), 8);
+}
+
+TEST(AccumulationBuffer, SaveAndLoad) {
+    AccumulationBuffer a(3, 2, 1.8);
+    a.AddSamples(2, 1, Vector3f(1, 2, 3), 2.5, 5);
+    std::string file_name = ::testing::TempDir() + "accumulation_buffer_test.acc";
+    a.Save(file_name);
+
+    AccumulationBuffer b = AccumulationBuffer::Load(file_name);
+    EXPECT_EQ(b.Width(), 3);
+    EXPECT_EQ(b.Height(), 2);
+    EXPECT_FLOAT_EQ(b.Gamma(), 1.8);
+    EXPECT_EQ(b.Count(2, 1), 5);
+    EXPECT_FLOAT_EQ(b.Mean(2, 1).y(), 0.8);
+    EXPECT_EQ(b.Count(0, 0), 0);
+    std::remove(file_name.c_str());
+
+    EXPECT_THROW(AccumulationBuffer::Load(file_name), std::runtime_error);
+}
+
+} // namespace RT::testing
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <Vector3f.h>
 
 #include "utils/ball_finder.hpp"
@@ -7,26 +10,18 @@
 
 namespace RT::testing {
 
-struct Ball {
-    Vector3f center;
-    float radius;
-};
-
 TEST(BallFinder, BasicTests) {
     RNG rng;
     for (int i = 0; i < 100; i++) {
-        BallFinder<Ball> bf(4.1);
+        BallFinder bf(4.1);
         Vector3f center = 10 * rng.RandNormalizedVector();
         Vector3f center2 = center + 0.1 * rng.RandNormalizedVector();
-        Ball b1{center, 0.48f};
-        Ball b2{center2, 1.f};
-        Ball b3{center + Vector3f(3, 0, 0), 2.f};
-        bf.AddBall(&b1);
-        bf.AddBall(&b2);
-        bf.AddBall(&b3);
+        std::vector<Vector3f> centers{center, center2, center + Vector3f(3, 0, 0)};
+        std::vector<float> radii{0.48f, 1.f, 2.f};
+        bf.Build(centers.data(), radii.data(), (int) centers.size());
         {
             int num_balls = 0;
-            bf.FindAndOperateBalls(center + 0.3 * rng.RandNormalizedVector(), [&](Ball *b) {
+            bf.FindAndOperateBalls(center + 0.3 * rng.RandNormalizedVector(), [&](int b) {
                 num_balls += 1;
             });
             ASSERT_EQ(num_balls, 2);
@@ -34,16 +29,16 @@ TEST(BallFinder, BasicTests) {
 
         {
             int num_balls = 0;
-            bf.FindAndOperateBalls(center + Vector3f(4.9, 0, 0), [&](Ball *b) {
+            bf.FindAndOperateBalls(center + Vector3f(4.9, 0, 0), [&](int b) {
                 num_balls += 1;
-                b->radius = 0.1;
+                radii[b] = 0.1;
             });
             ASSERT_EQ(num_balls, 1);
         }
 
         {
             int num_balls = 0;
-            bf.FindAndOperateBalls(center + Vector3f(3, 0.05, 0.05), [&](Ball *b) {
+            bf.FindAndOperateBalls(center + Vector3f(3, 0.05, 0.05), [&](int b) {
                 num_balls += 1;
             });
             ASSERT_EQ(num_balls, 1);
@@ -51,7 +46,7 @@ TEST(BallFinder, BasicTests) {
 
         {
             int num_balls = 0;
-            bf.FindAndOperateBalls(center + Vector3f(3, 0.1, 0.05), [&](Ball *b) {
+            bf.FindAndOperateBalls(center + Vector3f(3, 0.1, 0.05), [&](int b) {
                 num_balls += 1;
             });
             ASSERT_EQ(num_balls, 0);
@@ -59,4 +54,63 @@ TEST(BallFinder, BasicTests) {
     }
 }
 
+TEST(BallFinder, MatchesBruteForce) {
+    RNG rng;
+    const int num_balls_total = 2000;
+    std::vector<Vector3f> centers(num_balls_total);
+    std::vector<float> radii(num_balls_total);
+    BallFinder bf(0.2);
+    for (int i = 0; i < num_balls_total; i++) {
+        centers[i] = Vector3f(rng.RandUniformFloat(), rng.RandUniformFloat(), rng.RandUniformFloat()) * 2 - Vector3f(1, 1, 1);
+        radii[i] = 0.1f * rng.RandUniformFloat();
+    }
+    // every 10th ball is left out
+    bf.Build(centers.data(), radii.data(), num_balls_total, [](int i) { return i % 10 != 0; });
+
+    for (int i = 0; i < 1000; i++) {
+        Vector3f p = Vector3f(rng.RandUniformFloat(), rng.RandUniformFloat(), rng.RandUniformFloat()) * 2.2 - Vector3f(1.1, 1.1, 1.1);
+        int expected = 0;
+        for (int b = 0; b < num_balls_total; b++) {
+            expected += b % 10 != 0 && (centers[b] - p).squaredLength() <= radii[b] * radii[b];
+        }
+        int num_balls = 0;
+        bf.FindAndOperateBalls(p, [&](int b) {
+            ASSERT_NE(b % 10, 0);
+            num_balls += 1;
+        });
+        ASSERT_EQ(num_balls, expected);
+    }
+}
+
+TEST(BallFinder, QueryOrder) {
+    RNG rng;
+    std::vector<Vector3f> centers(500);
+    std::vector<float> radii(500, 0.05f);
+    for (auto &c: centers) {
+        c = rng.RandNormalizedVector();
+    }
+    BallFinder bf(0.1);
+    bf.Build(centers.data(), radii.data(), (int) centers.size());
+
+    std::vector<Vector3f> points(3000);
+    for (auto &p: points) {
+        p = rng.RandNormalizedVector();
+    }
+    std::vector<uint32_t> start;
+    std::vector<int> order = bf.QueryOrder(points.data(), (int) points.size(), start);
+    ASSERT_EQ(order.size(), points.size());
+    // the buckets partition the permutation
+    ASSERT_FALSE(start.empty());
+    EXPECT_EQ(start.front(), 0u);
+    EXPECT_EQ(start.back(), points.size());
+    for (int b = 0; b + 1 < (int) start.size(); b++) {
+        ASSERT_LE(start[b], start[b + 1]);
+    }
+    std::vector<int> sorted_order = order;
+    std::sort(sorted_order.begin(), sorted_order.end());
+    for (int i = 0; i < points.size(); i++) {
+        ASSERT_EQ(sorted_order[i], i);
+    }
+}
+
 } // namespace RT
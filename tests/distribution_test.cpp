@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "utils/alias_table.h"
+#include "utils/direction_guide.h"
+#include "utils/distribution.h"
+#include "utils/math_util.h"
+
+namespace RT::testing {
+
+TEST(AliasTable, Pmf) {
+    AliasTable table({1, 3, 0, 4});
+    ASSERT_EQ(table.Size(), 4);
+    EXPECT_FLOAT_EQ(table.Pmf(0), 0.125);
+    EXPECT_FLOAT_EQ(table.Pmf(1), 0.375);
+    EXPECT_FLOAT_EQ(table.Pmf(2), 0);
+    EXPECT_FLOAT_EQ(table.Pmf(3), 0.5);
+
+    AliasTable zero_table({0, 0});
+    EXPECT_FLOAT_EQ(zero_table.Pmf(0), 0.5);
+    EXPECT_FLOAT_EQ(zero_table.Pmf(1), 0.5);
+}
+
+TEST(AliasTable, SampleFrequency) {
+    RNG rng;
+    std::vector<float> weights{5, 0.1, 0, 2, 7, 1, 1, 0.5, 3};
+    AliasTable table(weights);
+
+    const int num_samples = 1000000;
+    std::vector<int> counts(weights.size());
+    for (int i = 0; i < num_samples; i++) {
+        counts[table.Sample(rng.RandUniformFloat())]++;
+    }
+    for (int i = 0; i < weights.size(); i++) {
+        EXPECT_NEAR((float) counts[i] / num_samples, table.Pmf(i), 0.003) << "index " << i;
+    }
+    EXPECT_EQ(counts[2], 0);
+
+    // u close to 1 must not overflow
+    EXPECT_LT(table.Sample(0.99999994f), weights.size());
+}
+
+TEST(PiecewiseConstant1D, SampleAndPdf) {
+    RNG rng;
+    PiecewiseConstant1D dist({1, 0, 3});
+    EXPECT_FLOAT_EQ(dist.Integral(), 4.f / 3);
+    EXPECT_FLOAT_EQ(dist.Pdf(0.1), 0.75);
+    EXPECT_FLOAT_EQ(dist.Pdf(0.5), 0);
+    EXPECT_FLOAT_EQ(dist.Pdf(0.9), 2.25);
+
+    int num_first = 0;
+    const int num_samples = 100000;
+    for (int i = 0; i < num_samples; i++) {
+        float pdf;
+        int offset;
+        float x = dist.Sample(rng.RandUniformFloat(), pdf, &offset);
+        ASSERT_GE(x, 0);
+        ASSERT_LT(x, 1);
+        ASSERT_NE(offset, 1);
+        ASSERT_FLOAT_EQ(pdf, dist.Pdf(x));
+        num_first += offset == 0;
+    }
+    EXPECT_NEAR((float) num_first / num_samples, 0.25, 0.01);
+}
+
+TEST(PiecewiseConstant2D, SampleAndPdf) {
+    RNG rng;
+    // 3 columns, 2 rows
+    std::vector<float> func{1, 2, 3,
+                            0, 0, 6};
+    PiecewiseConstant2D dist(func, 3, 2);
+
+    // the density integrates to 1 over the unit square
+    float integral = 0;
+    for (int v = 0; v < 2; v++) {
+        for (int u = 0; u < 3; u++) {
+            integral += dist.Pdf(Vector2f(((float) u + 0.5f) / 3, ((float) v + 0.5f) / 2)) / 6;
+        }
+    }
+    EXPECT_NEAR(integral, 1, 1e-5);
+
+    std::vector<int> counts(6);
+    const int num_samples = 200000;
+    for (int i = 0; i < num_samples; i++) {
+        float pdf;
+        Vector2f p = dist.Sample(rng.RandUniformFloat(), rng.RandUniformFloat(), pdf);
+        ASSERT_NEAR(pdf, dist.Pdf(p), 1e-4);
+        counts[std::min((int) (p.y() * 2), 1) * 3 + std::min((int) (p.x() * 3), 2)]++;
+    }
+    for (int i = 0; i < 6; i++) {
+        EXPECT_NEAR((float) counts[i] / num_samples, func[i] / 12, 0.005) << "cell " << i;
+    }
+}
+
+TEST(DirectionGuide, PdfMatchesSamples) {
+    RNG rng;
+    DirectionGuide guide;
+    // learn a preference for directions around +z
+    for (int i = 0; i < 10000; i++) {
+        Vector3f dir = rng.RandNormalizedVector();
+        if (dir.z() > 0.8) guide.Record(dir, 1);
+    }
+    guide.Update();
+
+    // the density integrates to 1 over the sphere
+    float integral = 0;
+    const int num_samples = 100000;
+    for (int i = 0; i < num_samples; i++) {
+        integral += guide.Pdf(rng.RandNormalizedVector()) * 4 * (float) M_PI / num_samples;
+    }
+    EXPECT_NEAR(integral, 1, 0.02);
+
+    int num_up = 0;
+    for (int i = 0; i < num_samples; i++) {
+        float pdf;
+        Vector3f dir = guide.Sample(rng, pdf);
+        ASSERT_NEAR(dir.length(), 1, 1e-4);
+        ASSERT_NEAR(pdf, guide.Pdf(dir), 1e-3 * pdf);
+        num_up += dir.z() > 0.8;
+    }
+    // half of the samples are uniform and hit z > 0.8 with probability 0.1
+    // the other half follow the histogram, whose bins are 0.125 wide in z: the bin [0.875, 1] holds 0.125 / 0.2
+    // of the records and bin [0.75, 0.875] the rest, of which 0.6 of the samples land in z > 0.8
+    EXPECT_NEAR((float) num_up / num_samples, 0.05 + 0.5 * (0.625 + 0.375 * 0.6), 0.01);
+}
+
+} // namespace RT::testing
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include <Vector3f.h>
+
+#include "utils/denoiser.h"
+#include "utils/film.h"
+#include "utils/filter.h"
+#include "utils/image.h"
+
+namespace RT::testing {
+
+TEST(Film, ConcurrentPixels) {
+    Film film(2, 1, true);
+#pragma omp parallel for default(none) shared(film)
+    for (int i = 0; i < 1000; i++) {
+        Film::Pixel pixel;
+        pixel.AddRadiance(Vector3f((float) (i % 2)));  // alternating 0 and 1
+        pixel.AddFeature({Vector3f(0.5), Vector3f(0, 0, 2), 3});
+        film.AddPixel(0, 0, pixel);
+    }
+
+    EXPECT_EQ(film.Count(0, 0), 1000);
+    EXPECT_FLOAT_EQ(film.Radiance(0, 0).y(), 0.5);
+    // luminance of 0 and 1 half of the time each
+    EXPECT_NEAR(film.Variance(0, 0), 0.25f * 1000 / 999, 1e-4);
+    EXPECT_FLOAT_EQ(film.Albedo(0, 0).x(), 0.5);
+    EXPECT_FLOAT_EQ(film.Normal(0, 0).z(), 1);
+    EXPECT_FLOAT_EQ(film.Depth(0, 0), 3);
+
+    EXPECT_EQ(film.Count(1, 0), 0);
+    EXPECT_EQ(film.Radiance(1, 0), Vector3f::ZERO);
+    EXPECT_EQ(film.Normal(1, 0), Vector3f::ZERO);
+    EXPECT_FLOAT_EQ(film.Variance(1, 0), 0);
+}
+
+TEST(Film, WithoutAOVs) {
+    Film film(1, 1, false);
+    Film::Pixel pixel;
+    pixel.AddRadiance(Vector3f(2, 4, 6));
+    pixel.AddRadiance(Vector3f(0, 0, 0));
+    pixel.AddFeature({Vector3f(1), Vector3f(1), 1});
+    film.AddPixel(0, 0, pixel);
+
+    EXPECT_EQ(film.Count(0, 0), 2);
+    EXPECT_FLOAT_EQ(film.Radiance(0, 0).x(), 1);
+    EXPECT_FLOAT_EQ(film.Radiance(0, 0).z(), 3);
+    EXPECT_FALSE(film.HasAOVs());
+    EXPECT_EQ(film.Albedo(0, 0), Vector3f::ZERO);
+}
+
+TEST(Film, AOVsWithoutStatistics) {
+    Film film(1, 1, true);
+    Film::Pixel pixel;
+    pixel.AddRadiance(Vector3f(1));
+    pixel.AddFeature({Vector3f(1), Vector3f(0, 1, 0), 2});
+    film.AddPixel(0, 0, pixel);
+    const std::string prefix = ::testing::TempDir() + "film_test";
+    film.SaveAOVs(prefix, false);
+
+    EXPECT_TRUE(std::filesystem::exists(prefix + "_depth.pfm"));
+    EXPECT_FALSE(std::filesystem::exists(prefix + "_variance.pfm"));
+    EXPECT_FALSE(std::filesystem::exists(prefix + "_samples.pfm"));
+    for (const char *name: {"albedo", "normal", "depth"}) {
+        std::filesystem::remove(prefix + "_" + name + ".pfm");
+    }
+}
+
+TEST(Film, SplatsAcrossTiles) {
+    MitchellFilter mitchell;
+    EXPECT_FLOAT_EQ(mitchell.Evaluate(0), 8.f / 9);
+    EXPECT_FLOAT_EQ(mitchell.Evaluate(2), 0);
+    EXPECT_LT(mitchell.Evaluate(1.5), 0);  // negative lobe
+    GaussianFilter gaussian;
+    EXPECT_FLOAT_EQ(gaussian.Evaluate(1.5), 0);
+
+    // a sample on the border of two tiles reaches pixels of both
+    Film film(4, 2, false);
+    Film::Tile left(0, 0, 2, 2, gaussian), right(2, 0, 4, 2, gaussian);
+    left.Splat(2, 1, Vector3f(1, 2, 3));
+    film.AddTile(left);
+    film.AddTile(right);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 1; x < 3; x++) {
+            EXPECT_FLOAT_EQ(film.Radiance(x, y).y(), 2);
+        }
+    }
+    // symmetric weights
+    Film::Tile other(2, 0, 4, 2, gaussian);
+    other.Splat(2, 1, Vector3f(0, 0, 0));
+    film.AddTile(other);
+    EXPECT_FLOAT_EQ(film.Radiance(1, 0).y(), 1);
+    EXPECT_FLOAT_EQ(film.Radiance(2, 1).y(), 1);
+
+    // the box filter keeps a sample in its pixel, even on the border
+    Film box_film(2, 1, false);
+    BoxFilter box;
+    Film::Tile box_tile(0, 0, 2, 1, box);
+    box_tile.Splat(1, 0.5, Vector3f(1));
+    box_film.AddTile(box_tile);
+    EXPECT_FLOAT_EQ(box_film.Radiance(0, 0).x(), 0);
+    EXPECT_FLOAT_EQ(box_film.Radiance(1, 0).x(), 1);
+}
+
+TEST(Denoiser, SmoothsNoiseAndKeepsEdges) {
+    // left half faces +z with radiance 1 on average, right half faces +x and is black
+    const int width = 64, height = 32, spp = 4;
+    Film film(width, height, true);
+    std::mt19937 gen(42);
+    std::exponential_distribution<float> noise(1);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const bool left = x < width / 2;
+            Film::Pixel pixel;
+            for (int s = 0; s < spp; s++) {
+                pixel.AddRadiance(left ? Vector3f(noise(gen)) : Vector3f::ZERO);
+                pixel.AddFeature({Vector3f(0.5), left ? Vector3f(0, 0, 1) : Vector3f(1, 0, 0), 2});
+            }
+            film.AddPixel(x, y, pixel);
+        }
+    }
+    Image img(width, height);
+    Denoiser().Denoise(film, img);
+
+    float error_before = 0, error_after = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width / 2; x++) {
+            error_before += std::abs(film.Radiance(x, y).x() - 1);
+            error_after += std::abs(img.GetPixel(x, y).x() - 1);
+        }
+        // nothing leaks across the edge
+        EXPECT_LT(img.GetPixel(width / 2, y).x(), 1e-3);
+    }
+    EXPECT_LT(error_after, error_before / 4);
+}
+
+} // namespace RT::testing
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Vector3f.h>
+
+#include "utils/image.h"
+
+namespace RT::testing {
+
+TEST(Image, PFMRoundTrip) {
+    Image img(3, 2);
+    img.SetPixel(0, 0, Vector3f(0.25, 1e-6, 0));
+    img.SetPixel(2, 1, Vector3f(1234.5, 7, 0.5));
+    const std::string file = ::testing::TempDir() + "image_test.pfm";
+    img.SaveImage(file.c_str(), PostProcess(2.2, 0, "aces"));  // no gamma or tone mapping for float output
+
+    std::unique_ptr<Image> loaded(Image::LoadPFM(file.c_str()));
+    ASSERT_EQ(loaded->Width(), 3);
+    ASSERT_EQ(loaded->Height(), 2);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 3; x++) {
+            EXPECT_EQ(loaded->GetPixel(x, y), img.GetPixel(x, y));
+        }
+    }
+    std::remove(file.c_str());
+}
+
+TEST(Image, PPMRoundTripWithGamma) {
+    Image img(5, 3);
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 5; x++) {
+            img.SetPixel(x, y, Vector3f((float) x / 4, (float) y / 2, x == y ? 2.f : -1.f));
+        }
+    }
+    const std::string file = ::testing::TempDir() + "image_test.ppm";
+    img.SavePPM(file.c_str(), PostProcess(2.2));
+
+    std::unique_ptr<Image> loaded(Image::LoadPPM(file.c_str()));
+    ASSERT_EQ(loaded->Width(), 5);
+    ASSERT_EQ(loaded->Height(), 3);
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 5; x++) {
+            for (int c = 0; c < 3; c++) {
+                float v = std::min(std::max(img.GetPixel(x, y)[c], 0.f), 1.f);
+                // 8-bit values are truncated, the lookup table may land one step off at a boundary
+                float expected = std::min(std::floor(std::pow(v, 1 / 2.2f) * 255), 255.f) / 255;
+                EXPECT_NEAR(loaded->GetPixel(x, y)[c], expected, 1.01f / 255);
+            }
+        }
+    }
+    std::remove(file.c_str());
+}
+
+TEST(PostProcess, ToneMapsAndEncoding) {
+    float values[4] = {1, 3, -1, 1000};
+    PostProcess(2.2, 1, "reinhard").Apply(values, 4);
+    EXPECT_FLOAT_EQ(values[0], 2.f / 3);
+    EXPECT_FLOAT_EQ(values[1], 6.f / 7);
+    EXPECT_FLOAT_EQ(values[2], 0);
+    EXPECT_NEAR(values[3], 1, 1e-3);
+
+    float aces[2] = {0, 1e6};
+    PostProcess(2.2, 0, "aces").Apply(aces, 2);
+    EXPECT_FLOAT_EQ(aces[0], 0);
+    EXPECT_NEAR(aces[1], 2.51f / 2.43f, 1e-3);
+
+    const int last = PostProcess::EncodeTableSize() - 1;
+    PostProcess srgb(2.2, 0, "none", true);
+    EXPECT_EQ(srgb.EncodeTable()[0], 0);
+    EXPECT_EQ(srgb.EncodeTable()[last / 2], 187);  // sRGB of 0.5 is 0.7354
+    EXPECT_EQ(srgb.EncodeTable()[last], 255);
+    EXPECT_EQ(PostProcess(1).EncodeTable()[last / 4], 63);
+
+    EXPECT_THROW(PostProcess(2.2, 0, "filmic"), std::runtime_error);
+}
+
+TEST(Image, EXRHeaderAndCompression) {
+    Image img(64, 4);
+    img.SetAllPixels(Vector3f(0.5, 1, 2));
+    const std::string file = ::testing::TempDir() + "image_test.exr";
+    img.SaveImage(file.c_str());
+
+    std::ifstream in(file, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_GT(bytes.size(), 8u);
+    int32_t magic, version;
+    memcpy(&magic, bytes.data(), 4);
+    memcpy(&version, bytes.data() + 4, 4);
+    EXPECT_EQ(magic, 20000630);
+    EXPECT_EQ(version, 2);
+    EXPECT_NE(std::string(bytes.begin(), bytes.end()).find("dataWindow"), std::string::npos);
+    // constant scanlines must be run length encoded, 4 lines of 64 half RGB pixels are 1536 bytes raw
+    EXPECT_LT(bytes.size(), 1536u);
+    std::remove(file.c_str());
+}
+
+// value of a normal or zero binary16
+static float half_to_float(uint16_t h) {
+    const int exponent = (h >> 10) & 0x1f;
+    const float value = exponent == 0 ? 0 : std::ldexp(1 + (float) (h & 0x3ff) / 1024, exponent - 15);
+    return h & 0x8000 ? -value : value;
+}
+
+TEST(Image, EXRChunkRoundTrip) {
+    // a ramp in R is stored as literals, the constant G and B as runs; all values are exact in half
+    const int width = 64;
+    Image img(width, 2);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < width; x++) {
+            img.SetPixel(x, y, Vector3f((float) x / 64 + (float) y, 1, 0.25));
+        }
+    }
+    const std::string file = ::testing::TempDir() + "image_test_chunk.exr";
+    img.SaveImage(file.c_str());
+    std::ifstream in(file, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::remove(file.c_str());
+
+    // skip the attributes, name and type strings then the size of the value, up to the empty name
+    size_t pos = 8;
+    while (bytes.at(pos) != 0) {
+        pos += strlen(&bytes[pos]) + 1;
+        pos += strlen(&bytes.at(pos)) + 1;
+        int32_t size;
+        memcpy(&size, &bytes.at(pos), 4);
+        pos += 4 + size;
+    }
+    uint64_t offset;
+    memcpy(&offset, &bytes.at(pos + 1), 8);
+    int32_t line, size;
+    memcpy(&line, &bytes.at(offset), 4);
+    memcpy(&size, &bytes.at(offset + 4), 4);
+    EXPECT_EQ(line, 0);
+    const int raw_size = 3 * 2 * width;
+    ASSERT_LT(size, raw_size);  // compressed
+    ASSERT_LE(offset + 8 + size, bytes.size());
+
+    // undo the run length encoding: a negative count is followed by as many literals,
+    // a count n >= 0 by a byte repeated n + 1 times
+    std::vector<unsigned char> tmp;
+    for (const char *p = &bytes[offset + 8], *end = p + size; p < end;) {
+        const int count = (signed char) *p++;
+        if (count < 0) {
+            tmp.insert(tmp.end(), p, p - count);
+            p -= count;
+        } else {
+            tmp.insert(tmp.end(), count + 1, (unsigned char) *p++);
+        }
+    }
+    ASSERT_EQ(tmp.size(), (size_t) raw_size);
+    // undo the delta predictor, then the split of even and odd bytes into two halves
+    for (int i = 1; i < raw_size; i++) {
+        tmp[i] = (unsigned char) (tmp[i - 1] + tmp[i] - 128);
+    }
+    std::vector<unsigned char> raw(raw_size);
+    for (int i = 0; i < raw_size; i++) {
+        raw[i] = tmp[i % 2 ? raw_size / 2 + i / 2 : i / 2];
+    }
+
+    // the first chunk is the top row, channels B, G, R, each a run of width halves
+    for (int c = 0; c < 3; c++) {
+        for (int x = 0; x < width; x++) {
+            uint16_t h;
+            memcpy(&h, &raw[2 * (c * width + x)], 2);
+            EXPECT_FLOAT_EQ(half_to_float(h), img.GetPixel(x, 1)[2 - c]) << "channel " << c << " x " << x;
+        }
+    }
+}
+
+} // namespace RT::testing
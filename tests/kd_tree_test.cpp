@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <Vector3f.h>
+
+#include "utils/kd_tree.hpp"
+#include "utils/math_util.h"
+
+namespace RT::testing {
+
+TEST(KdTree, MatchesBruteForce) {
+    RNG rng;
+    for (int num_points: {0, 1, 2, 7, 50000}) {
+        std::vector<Vector3f> points(num_points);
+        for (int i = 0; i < num_points; i++) {
+            // a flat distribution, plus some duplicated points
+            points[i] = i % 7 == 3 ? points[i - 1] : Vector3f(rng.RandUniformFloat(), rng.RandUniformFloat(), 0.1f * rng.RandUniformFloat());
+        }
+        KdTree tree;
+        tree.Build(points.data(), num_points);
+        ASSERT_EQ(tree.Size(), num_points);
+
+        for (int i = 0; i < 200; i++) {
+            Vector3f p(rng.RandUniformFloat(), rng.RandUniformFloat(), rng.RandUniformFloat() * 0.2f);
+            float radius = 0.05f * rng.RandUniformFloat();
+            std::vector<int> expected, found;
+            for (int j = 0; j < num_points; j++) {
+                if ((points[j] - p).squaredLength() <= radius * radius) {
+                    expected.emplace_back(j);
+                }
+            }
+            tree.FindInRadius(p, radius, [&](int j) {
+                found.emplace_back(j);
+            });
+            std::sort(found.begin(), found.end());
+            ASSERT_EQ(found, expected);
+        }
+    }
+}
+
+} // namespace RT
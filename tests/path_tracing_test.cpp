@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <Vector3f.h>
+
+#include "renderers/path_tracing.h"
+#include "utils/debug.h"
+#include "utils/image.h"
+#include "utils/scene_parser.h"
+
+namespace RT::testing {
+
+// a lambert floor under a large sphere, given as light or emitter, which the camera below it does not see
+static std::string write_scene(const std::string &name, const std::string &light) {
+    const std::string file = ::testing::TempDir() + name + ".yml";
+    std::ofstream(file) << "camera:\n"
+                           "  pos: 0, 3, 0\n"
+                           "  dir: 0, -1, 0\n"
+                           "  up: 0, 0, -1\n"
+                           "  width: 16\n"
+                           "  height: 16\n"
+                           "  angle: 30\n"
+                        << light <<
+                           "  - type: plane\n"
+                           "    normal: 0 1 0\n"
+                           "    d: 0\n"
+                           "    texture_up: 0 0 -1\n"
+                           "    mat: {illum: 1, Ka: 0.5 0.5 0.5}\n";
+    return file;
+}
+
+// mean radiance of the image, direct light only
+static Vector3f render(const std::string &scene) {
+    SceneParser parser;
+    parser.parse(scene);
+    PathTracingRender renderer(4, 16, 1, 5, "uniform", parser);
+    const std::string output = scene.substr(0, scene.rfind('.')) + ".pfm";
+    renderer.Render(*parser.scene, *parser.camera, output);
+    std::unique_ptr<Image> img(Image::LoadPFM(output.c_str()));
+    std::remove(output.c_str());
+    std::remove(scene.c_str());
+    Vector3f mean;
+    for (int y = 0; y < img->Height(); y++) {
+        for (int x = 0; x < img->Width(); x++) {
+            mean += img->GetPixel(x, y);
+        }
+    }
+    return mean / (float) (img->Width() * img->Height());
+}
+
+// a sphere light of the scene file is only found by sampling it, its samples must get the full weight
+// an emissive sphere of the same radiance is found by both strategies and weighted by MIS
+TEST(PathTracing, SphereLightMatchesEmitter) {
+    // the sphere covers much of the sky of the floor, so BSDF sampled rays often reach it
+    const float radiance = 1, radius = 10;
+    const float power = radiance * 4 * (float) (M_PI * M_PI) * radius * radius;
+    Vector3f light = render(write_scene("path_tracing_test_light", fmt::format(
+            "lights:\n"
+            "  - type: sphere\n"
+            "    center: 0 13.5 0\n"
+            "    radius: {}\n"
+            "    color: {} {} {}\n"
+            "world:\n", radius, power, power, power)));
+    Vector3f emitter = render(write_scene("path_tracing_test_emitter", fmt::format(
+            "world:\n"
+            "  - type: sphere\n"
+            "    center: 0 13.5 0\n"
+            "    r: {}\n"
+            "    mat: {{illum: 1, Ka: 0 0 0, Ke: {} {} {}}}\n", radius, radiance, radiance, radiance)));
+    for (int c = 0; c < 3; c++) {
+        EXPECT_GT(emitter[c], 0);
+        EXPECT_NEAR(light[c], emitter[c], 0.03 * emitter[c]) << "channel " << c;
+    }
+}
+
+} // namespace RT::testing
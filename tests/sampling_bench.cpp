@@ -0,0 +1,48 @@
+// micro benchmark of discrete sampling: alias table vs. binary search over the CDF
+#include <chrono>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "utils/alias_table.h"
+#include "utils/distribution.h"
+#include "utils/math_util.h"
+
+template<typename F>
+double ns_per_call(const std::vector<float> &us, F &&f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    long long checksum = 0;
+    for (float u: us) {
+        checksum += f(u);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    if (checksum == -1) fmt::print("");  // keep the loop from being optimized out
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double) us.size();
+}
+
+int main() {
+    RT::RNG rng;
+    std::vector<float> us(1 << 22);
+    for (float &u: us) {
+        u = rng.RandUniformFloat();
+    }
+
+    fmt::print("{:>10} {:>14} {:>14}\n", "size", "alias (ns)", "cdf (ns)");
+    for (int n = 16; n <= (1 << 22); n *= 8) {
+        std::vector<float> weights(n);
+        for (float &w: weights) {
+            w = rng.RandUniformFloat() * rng.RandUniformFloat();
+        }
+        RT::AliasTable table(weights);
+        RT::PiecewiseConstant1D dist(weights);
+
+        double alias_ns = ns_per_call(us, [&](float u) { return table.Sample(u); });
+        double cdf_ns = ns_per_call(us, [&](float u) {
+            float pdf;
+            int offset;
+            dist.Sample(u, pdf, &offset);
+            return offset;
+        });
+        fmt::print("{:>10} {:>14.2f} {:>14.2f}\n", n, alias_ns, cdf_ns);
+    }
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <lodepng.h>
+
+#include "objects/group.h"
+#include "utils/scene_parser.h"
+
+namespace RT::testing {
+
+// two spheres with the same material and texture, the texture file spelled as texture_file_a and texture_file_b
+static std::string write_scene(const std::string &texture_file_a, const std::string &texture_file_b) {
+    // named after the test, tests may run concurrently
+    const std::string file = ::testing::TempDir() + "scene_parser_test_" +
+                             ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".yml";
+    std::ofstream(file) << "camera:\n"
+                           "  pos: 0, 0, 3\n"
+                           "  dir: 0, 0, -1\n"
+                           "  up: 0, 1, 0\n"
+                           "  width: 4\n"
+                           "  height: 4\n"
+                           "  angle: 50\n"
+                           "world:\n"
+                           "  - type: sphere\n"
+                           "    center: -1 0 0\n"
+                           "    r: 0.5\n"
+                           "    mat: {illum: 1, Ka: 0.5 0.5 0.5}\n"
+                           "    texture: {file: " << texture_file_a << "}\n"
+                           "  - type: sphere\n"
+                           "    center: 1 0 0\n"
+                           "    r: 0.5\n"
+                           "    mat: {illum: 1, Ka: 0.5 0.5 0.5}\n"
+                           "    texture: {file: " << texture_file_b << "}\n";
+    return file;
+}
+
+TEST(SceneParser, SharesTexturesAndMaterials) {
+    const std::string dir = ::testing::TempDir();
+    std::vector<uint8_t> rgba(2 * 2 * 4, 255);
+    ASSERT_EQ(lodepng::encode(dir + "t.png", rgba, 2, 2), 0u);
+    const std::string scene = write_scene(dir + "./t.png", dir + "t.png");
+    SceneParser parser;
+    parser.parse(scene);
+    std::remove(scene.c_str());
+    std::remove((dir + "t.png").c_str());
+
+    auto *group = dynamic_cast<Group *>(parser.scene.get());
+    ASSERT_NE(group, nullptr);
+    ASSERT_EQ(group->objects.size(), 2u);
+    auto *a = dynamic_cast<SimpleObject3D *>(group->objects[0].get());
+    auto *b = dynamic_cast<SimpleObject3D *>(group->objects[1].get());
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_NE(a->texture, nullptr);
+    EXPECT_EQ(a->texture, b->texture);
+    EXPECT_EQ(a->material, b->material);
+}
+
+TEST(SceneParser, MissingTextureThrows) {
+    const std::string missing = ::testing::TempDir() + "scene_parser_test_missing.png";
+    const std::string scene = write_scene(missing, missing);
+    SceneParser parser;
+    EXPECT_THROW(parser.parse(scene), std::runtime_error);
+    std::remove(scene.c_str());
+}
+
+} // namespace RT::testing
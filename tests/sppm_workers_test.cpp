@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "renderers/photon_mapping.h"
+#include "utils/image.h"
+#include "utils/scene_parser.h"
+
+namespace RT::testing {
+
+// files of each test are named after it, so that tests may run concurrently
+static std::string temp_path(const std::string &suffix) {
+    return ::testing::TempDir() + "sppm_workers_test_" +
+           ::testing::UnitTest::GetInstance()->current_test_info()->name() + suffix;
+}
+
+// a small diffuse box lit by a sphere light
+static std::string write_scene() {
+    const std::string file = temp_path(".yml");
+    std::ofstream(file) << R"(gamma: 2.2
+camera:
+  pos: 0, 1, 3
+  dir: 0, -0.05, -1
+  up: 0, 1, 0
+  width: 32
+  height: 24
+  angle: 50
+lights:
+  - type: sphere
+    center: 0 1.6 0
+    radius: 0.1
+    color: 10 10 10
+world:
+  - type: sphere
+    center: 0.5 0.3 -0.2
+    r: 0.3
+    mat: {illum: 1, Ka: 0.8 0.8 0.2}
+  - type: plane
+    normal: 0 0 1
+    d: -1
+    mat: {illum: 1, Ka: 1 1 1}
+  - type: plane
+    normal: 0 1 0
+    d: 0
+    mat: {illum: 1, Ka: 1 1 1}
+  - type: plane
+    normal: 0 1 0
+    d: 2
+    mat: {illum: 1, Ka: 1 1 1}
+  - type: plane
+    normal: 1 0 0
+    d: -2
+    mat: {illum: 1, Ka: 0.75 0.25 0.25}
+  - type: plane
+    normal: 1 0 0
+    d: 2
+    mat: {illum: 1, Ka: 0.25 0.25 0.75}
+)";
+    return file;
+}
+
+static std::string shard_dir() {
+    return temp_path("_shards");
+}
+
+// the options of the renderer below, as passed to RT_sppm
+static std::vector<std::string> sppm_options(const std::string &scene, int num_workers) {
+    return {RT_SPPM_PATH, "-i", scene, "-n", "4", "-p", "20000", "-r", "0.05",
+            "--workers", std::to_string(num_workers), "--shard-dir", shard_dir()};
+}
+
+static Vector3f render(const std::string &scene, int num_workers, const std::vector<std::string> &worker_command) {
+    SceneParser scene_parser;
+    scene_parser.parse(scene.c_str());
+    PhotonMappingRender renderer(0.7, 0.05, 4, 20000, 1, "grid", false, scene_parser);
+    if (num_workers > 0) {
+        renderer.SetWorkers(num_workers, shard_dir(), worker_command);
+    }
+    const std::string output = temp_path(".pfm");
+    renderer.Render(output);
+    std::unique_ptr<Image> img(Image::LoadPFM(output.c_str()));
+    std::remove(output.c_str());
+    Vector3f mean;
+    for (int y = 0; y < img->Height(); y++) {
+        for (int x = 0; x < img->Width(); x++) {
+            mean += img->GetPixel(x, y);
+        }
+    }
+    return mean / (float) (img->Width() * img->Height());
+}
+
+TEST(SPPMWorkers, MatchInProcess) {
+    const std::string scene = write_scene();
+    Vector3f expected = render(scene, 0, {});
+    Vector3f actual = render(scene, 2, sppm_options(scene, 2));
+    std::remove(scene.c_str());
+    // the photons differ, the estimate of the mean radiance does not
+    for (int c = 0; c < 3; c++) {
+        EXPECT_GT(expected[c], 0);
+        EXPECT_NEAR(actual[c], expected[c], 0.05 * expected[c]) << "channel " << c;
+    }
+    EXPECT_TRUE(std::filesystem::is_empty(shard_dir()));
+}
+
+TEST(SPPMWorkers, FailingWorkerRemovesFiles) {
+    const std::string scene = write_scene();
+    EXPECT_THROW(render(scene, 2, {"false"}), std::runtime_error);
+    std::remove(scene.c_str());
+    EXPECT_TRUE(std::filesystem::is_empty(shard_dir()));
+}
+
+}  // namespace RT::testing
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <lodepng.h>
+#include <Vector3f.h>
+
+#include "core/ray.h"
+#include "core/texture.h"
+#include "core/texture_cache.h"
+
+namespace RT::testing {
+
+// a width x height checkerboard of single texels, black and white
+static std::string write_checker(int width, int height, const std::string &name = "texture_test.png") {
+    std::vector<uint8_t> rgba(width * height * 4);
+    for (int i = 0; i < width * height; i++) {
+        uint8_t c = (i % width + i / width) % 2 ? 255 : 0;
+        rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = c;
+        rgba[4 * i + 3] = 255;
+    }
+    const std::string file = ::testing::TempDir() + name;
+    EXPECT_EQ(lodepng::encode(file, rgba, width, height), 0u);
+    return file;
+}
+
+TEST(MappedTexture, MipPyramid) {
+    const std::string file = write_checker(8, 6);
+    MappedTexture texture(file, 1);
+    std::remove(file.c_str());
+    // 8x6, 4x3, 2x1, 1x1, each padded to a tile of 8x8 RGB bytes
+    EXPECT_EQ(texture.Levels(), 4);
+    EXPECT_EQ(texture.Bytes(), 4 * 8 * 8 * 3);
+
+    const float white = 255.f / 256.f;
+    // texel centers of the full resolution image
+    EXPECT_FLOAT_EQ(texture.At(0.5f / 8, 0.5f / 6).x(), 0);
+    EXPECT_FLOAT_EQ(texture.At(1.5f / 8, 0.5f / 6).x(), white);
+    // halfway between texels, and wrapping around the edge
+    EXPECT_FLOAT_EQ(texture.At(1.f / 8, 0.5f / 6).x(), white / 2);
+    EXPECT_FLOAT_EQ(texture.At(1.f, 0.5f / 6).x(), white / 2);
+    EXPECT_FLOAT_EQ(texture.At(1.5f / 8 + 3, 0.5f / 6 - 2).x(), white);
+
+    // a tiny footprint keeps the full resolution, a larger one blurs the checkers to their average,
+    // stored again in 8 bits
+    EXPECT_FLOAT_EQ(texture.At(1.5f / 8, 0.5f / 6, 0.01f).x(), white);
+    for (float width: {0.25f, 0.5f, 1.f, 100.f}) {
+        for (float u: {0.1f, 0.4f, 0.8f}) {
+            EXPECT_NEAR(texture.At(u, 0.3f, width).x(), white / 2, 1.f / 256) << width << " " << u;
+        }
+    }
+}
+
+// lookups over the whole pyramid give the same texels as the texture kept in memory
+static void expect_same_texels(const MappedTexture &mapped, const MappedTexture &in_memory) {
+    ASSERT_EQ(mapped.Levels(), in_memory.Levels());
+    for (int i = 0; i < 2000; i++) {
+        float u = (float) (i * 37 % 1000) / 1000, v = (float) (i * 91 % 997) / 997;
+        float width = (float) (i % 11) / 1000;
+        ASSERT_EQ(mapped.At(u, v, width), in_memory.At(u, v, width)) << u << " " << v << " " << width;
+    }
+}
+
+TEST(TextureCache, PagesWithinBudget) {
+    // about 1 MB of texels, read through a cache that keeps only 4 pages
+    const std::string file = write_checker(600, 500, "texture_cache_test.png");
+    const std::string directory = ::testing::TempDir() + "texture_cache_test";
+    MappedTexture in_memory(file, 2.2f);
+    {
+        TextureCache cache(directory, 4 * TextureCache::page_bytes);
+        MappedTexture mapped(file, 2.2f, cache);
+        expect_same_texels(mapped, in_memory);
+        EXPECT_GT(cache.ResidentBytes(), 0u);
+        EXPECT_LE(cache.ResidentBytes(), 4 * TextureCache::page_bytes);
+    }
+    {
+        // the converted file is found again, and still matches
+        TextureCache cache(directory, 4 * TextureCache::page_bytes);
+        MappedTexture mapped(file, 2.2f, cache);
+        expect_same_texels(mapped, in_memory);
+    }
+    {
+        // the coarse levels of a scene with another gamma are averaged with that gamma
+        MappedTexture linear_in_memory(file, 1.f);
+        TextureCache cache(directory, 4 * TextureCache::page_bytes);
+        MappedTexture linear(file, 1.f, cache);
+        MappedTexture mapped(file, 2.2f, cache);
+        expect_same_texels(linear, linear_in_memory);
+        expect_same_texels(mapped, in_memory);
+        EXPECT_NE(linear.At(0.3f, 0.7f, 1.f), mapped.At(0.3f, 0.7f, 1.f));
+    }
+    TextureCache probe(directory, 0);
+    {
+        // a file cut short is converted again
+        std::filesystem::resize_file(probe.CachePath(file, 2.2f), 5000);
+        TextureCache cache(directory, 4 * TextureCache::page_bytes);
+        MappedTexture mapped(file, 2.2f, cache);
+        expect_same_texels(mapped, in_memory);
+    }
+    std::remove(probe.CachePath(file, 2.2f).c_str());
+    std::remove(probe.CachePath(file, 1.f).c_str());
+    std::remove(file.c_str());
+    std::remove(directory.c_str());
+}
+
+TEST(Ray, DifferentialsFollowMirror) {
+    // rays one unit apart hitting the plane y = 0, at 45 degrees
+    Ray ray(Vector3f(0, 1, 0), Vector3f(1, -1, 0), 0);
+    ray.SetDifferentials(Vector3f(0, 1, 1), Vector3f(1, -1, 0), Vector3f(0.5, 1, 0), Vector3f(1, -1, 0));
+    Vector3f normal(0, 1, 0), dpdx, dpdy;
+    ASSERT_TRUE(ray.Footprint(Vector3f(1, 0, 0), normal, dpdx, dpdy));
+    EXPECT_NEAR((dpdx - Vector3f(0, 0, 1)).length(), 0, 1e-6f);
+    EXPECT_NEAR((dpdy - Vector3f(0.5, 0, 0)).length(), 0, 1e-6f);
+
+    // the mirrored parallel rays stay parallel, so the footprint keeps its size on a plane above
+    Ray reflected(Vector3f(1, 0, 0), Vector3f(1, 1, 0), 0);
+    reflected.PropagateSpecular(ray, normal, 1);
+    ASSERT_TRUE(reflected.HasDifferentials());
+    ASSERT_TRUE(reflected.Footprint(Vector3f(2, 1, 0), normal, dpdx, dpdy));
+    EXPECT_NEAR((dpdx - Vector3f(0, 0, 1)).length(), 0, 1e-5f);
+    EXPECT_NEAR((dpdy - Vector3f(0.5, 0, 0)).length(), 0, 1e-5f);
+
+    // a direction off the mirror one is a glossy or diffuse sample, without a known footprint
+    Ray scattered(Vector3f(1, 0, 0), Vector3f(0, 1, 0), 0);
+    scattered.PropagateSpecular(ray, normal, 1);
+    EXPECT_FALSE(scattered.HasDifferentials());
+}
+
+} // namespace RT::testing